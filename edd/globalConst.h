@@ -23,7 +23,19 @@
 #define _globalConst_h_included_
 
 #define     cPI             3.14159265
-#define     randDouble      ((double)rand() / (double)RAND_MAX)
 #define     maxNodes        64
 
+// the camera is put into nodes 0 .. nrOfSensorNodes - 1 before every brain update, and the brain acts through
+// nodes maxNodes - nrOfOutputNodes .. maxNodes - 1 (camera moves, done, classify and veto bits)
+#define     nrOfSensorNodes     13
+#define     nrOfOutputNodes     26
+
+// gates adjust their own probability tables from feedback nodes;
+// the brain then runs gate by gate instead of through the compiled tBrain program
+//#define     feedbackON
+
+// count every heap allocation, so -bench can report how many an evaluation makes;
+// this replaces operator new for the whole program and is meant for benchmark builds only
+//#define     countAllocations
+
 #endif
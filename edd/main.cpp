@@ -31,16 +31,66 @@
 #include <iostream>
 #include <fstream>
 #include <dirent.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <mutex>
+#include <functional>
 
 #include "globalConst.h"
 #include "tHMM.h"
 #include "tAgent.h"
 #include "tGame.h"
-
-string  findBestRun(tAgent *eddAgent);
+#include "tRNG.h"
+#include "tThreadPool.h"
+#include "tDataset.h"
+#include "tCheckpoint.h"
+#include "tAgentQueue.h"
+#include "tFitnessCache.h"
 
 using namespace std;
 
+// one population evolving on its own: the whole population of a run, or one of the islands of -islands
+struct tIsland{
+    int index;
+    // draws the batches and pairs the agents up: masterRNG for a single population, a stream of its own for an island
+    tRNG *rng;
+    // the thread that evaluates all of the island's agents, or -1 to spread them over the thread pool
+    int thread;
+    vector<tAgent*> agents, nextGeneration;
+    // copy of the best agent of the last generation, and its fitness
+    tAgent *bestAgent;
+    double maxFitness;
+    // digits to draw the batches from
+    vector<int> allDigits, batchDigits;
+    // agents of past generations that nothing points at anymore, ready to be inherited into again
+    vector<tAgent*> spareAgents;
+    // scratch for picking the migrants
+    vector<int> ranking;
+    // fitness of the brains of the last generation
+    tFitnessCache fitnessCache;
+    // migrants arrive from the previous island and leave for the next one
+    tAgentQueue *incoming, *outgoing;
+};
+
+string  findBestRun(tAgent *eddAgent);
+tAgent  *newAgent(tIsland &island);
+void    retireAgent(tIsland &island, tAgent *agent);
+void    benchmark(int evaluations);
+void    saveGenome(tAgent *agent, const char *filename, double fitness);
+void    writeCheckpoint(int update, const string &LODFileName, const string &genomeFileName, tIsland &population);
+bool    readCheckpointOptions(string &LODFileName, string &genomeFileName, bool keepGenerations);
+bool    readCheckpointRun(int &update, tIsland &population);
+void    setupIsland(tIsland &island, int index);
+void    seedIsland(tIsland &island);
+void    forEachAgent(tIsland &island, int count, const function<void(int, int)> &job);
+void    evolveGeneration(tIsland &island, int update, const string &genomeFileName);
+string  islandName(tIsland &island);
+string  islandFileName(tIsland &island);
+void    sendMigrants(tIsland &island, int update);
+void    receiveMigrants(tIsland &island);
+
 double  perSiteMutationRate         = 0.005;
 int     populationSize              = 100;
 int     totalGenerations            = 252;
@@ -61,22 +111,85 @@ bool    zoomingCamera               = false;
 bool    randomStart                 = false;
 bool    noise                       = false;
 float   noiseAmount                 = 0.05;
+int     nrOfThreads                 = 1;
+tThreadPool *threadPool             = NULL;
+tRNG    masterRNG;
+string  datasetFileName             = "mnist.train.discrete.28x28-only100";
+int     batchSize                   = 0;
+int     fullEvaluationFrequency     = 0;
+int     raceChunkSize               = 0;
+int     sensorViewsMegabytes        = 256;
+int     benchmarkEvaluations        = 0;
+bool    binaryGenomes               = false;
+int     checkpointFrequency         = 0;
+string  checkpointFileName          = "";
+string  resumeFileName              = "";
+tCheckpoint checkpoint;
+int     nrOfIslands                 = 0;
+int     migrationFrequency          = 0;
+int     nrOfMigrants                = 5;
+bool    fitnessCaching              = true;
+// keeps the output lines of concurrently running islands apart
+mutex   outputLock;
+
+#ifdef countAllocations
+// every heap allocation goes through here and is counted, so -bench can report them
+atomic<unsigned long> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+    ++heapAllocations;
+    
+    void *memory = malloc(size == 0 ? 1 : size);
+    
+    if (memory == NULL)
+    {
+        throw bad_alloc();
+    }
+    
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+#endif
 
 int main(int argc, char *argv[])
 {
-  vector<tAgent*> eddAgents, EANextGen;
   tAgent *eddAgent = NULL, *bestEddAgent = NULL;
   double eddMaxFitness = 0.0;
   string LODFileName = "", eddGenomeFileName = "", inputGenomeFileName = "";
   string eddDotFileName = "", logicTableFileName = "", visualizationFileName = "";
   int displayDirectoryArgvIndex = 0;
+  bool generationsSet = false;
   
     // initial object setup
-    eddAgents.resize(populationSize);
 	eddAgent = new tAgent;
     
     // time-based seed by default. can change with command-line parameter.
-    srand((unsigned int)time(NULL));
+    masterRNG.seed((uint64_t)time(NULL));
     
     for (int i = 1; i < argc; ++i)
     {
@@ -84,7 +197,11 @@ int main(int argc, char *argv[])
         if (strcmp(argv[i], "-d") == 0 && (i + 1) < argc)
         {
             ++i;
-            eddAgent->loadAgent(argv[i]);
+            if (!eddAgent->loadAgent(argv[i]))
+            {
+                cerr << "could not load genome file " << argv[i] << endl;
+                exit(0);
+            }
             
             ++i;
             stringstream vizfn;
@@ -121,7 +238,7 @@ int main(int argc, char *argv[])
         else if (strcmp(argv[i], "-s") == 0 && (i + 1) < argc)
         {
             ++i;
-            srand(atoi(argv[i]));
+            masterRNG.seed(atoi(argv[i]));
             
             cout << "random seed set to " << atoi(argv[i]) << endl;
         }
@@ -131,6 +248,7 @@ int main(int argc, char *argv[])
         {
             ++i;
             totalGenerations = atoi(argv[i]);
+            generationsSet = true;
             
             if (totalGenerations < 5)
             {
@@ -188,7 +306,11 @@ int main(int argc, char *argv[])
         else if (strcmp(argv[i], "-lt") == 0 && (i + 2) < argc)
         {
             ++i;
-            eddAgent->loadAgent(argv[i]);
+            if (!eddAgent->loadAgent(argv[i]))
+            {
+                cerr << "could not load genome file " << argv[i] << endl;
+                exit(0);
+            }
             eddAgent->setupPhenotype();
             ++i;
             stringstream ltfn;
@@ -201,7 +323,11 @@ int main(int argc, char *argv[])
         else if (strcmp(argv[i], "-df") == 0 && (i + 2) < argc)
         {
             ++i;
-            eddAgent->loadAgent(argv[i]);
+            if (!eddAgent->loadAgent(argv[i]))
+            {
+                cerr << "could not load genome file " << argv[i] << endl;
+                exit(0);
+            }
             eddAgent->setupPhenotype();
             ++i;
             stringstream dfn;
@@ -251,10 +377,212 @@ int main(int argc, char *argv[])
             noiseAmount = atof(argv[i]);
             cout << "noise enabled with probability: " << noiseAmount << endl;
         }
+        
+        // -threads [int]: evaluate the population on the given number of threads
+        else if (strcmp(argv[i], "-threads") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            nrOfThreads = atoi(argv[i]);
+            
+            if (nrOfThreads < 1)
+            {
+                cerr << "minimum number of threads is 1." << endl;
+                exit(0);
+            }
+            
+            cout << "evaluation threads set to " << nrOfThreads << endl;
+        }
+        
+        // -cd [in file name] [out file name]: convert a text digit file to the binary format and exit
+        else if (strcmp(argv[i], "-cd") == 0 && (i + 2) < argc)
+        {
+            int nrOfImages = tDataset::convertText(argv[i + 1], argv[i + 2]);
+            
+            if (nrOfImages <= 0)
+            {
+                cerr << "could not convert " << argv[i + 1] << " to " << argv[i + 2] << endl;
+                exit(0);
+            }
+            
+            cout << "converted " << nrOfImages << " digits to " << argv[i + 2] << endl;
+            exit(0);
+        }
+        
+        // -batch [int]: evaluate every generation on a random batch of this many digits
+        // shared by the whole population instead of on all digits
+        else if (strcmp(argv[i], "-batch") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            batchSize = atoi(argv[i]);
+            
+            if (batchSize < 1)
+            {
+                cerr << "minimum batch size is 1." << endl;
+                exit(0);
+            }
+            
+            cout << "batch size set to " << batchSize << endl;
+        }
+        
+        // -batchfull [int]: with -batch, evaluate the best agent on all digits every so many generations
+        else if (strcmp(argv[i], "-batchfull") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            fullEvaluationFrequency = atoi(argv[i]);
+            
+            if (fullEvaluationFrequency < 1)
+            {
+                cerr << "minimum full evaluation frequency is 1." << endl;
+                exit(0);
+            }
+            
+            cout << "full evaluation of the best agent every " << fullEvaluationFrequency << " generations" << endl;
+        }
+        
+        // -race [int]: evaluate tournament partners side by side in chunks of this many digits
+        // and stop evaluating an agent once it cannot win its tournament anymore
+        else if (strcmp(argv[i], "-race") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            raceChunkSize = atoi(argv[i]);
+            
+            if (raceChunkSize < 1)
+            {
+                cerr << "minimum race chunk size is 1." << endl;
+                exit(0);
+            }
+            
+            cout << "racing evaluation enabled with chunks of " << raceChunkSize << " digits" << endl;
+        }
+        
+        // -views [int]: the most memory in MB the precomputed camera views for -zc and -rs may take
+        else if (strcmp(argv[i], "-views") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            sensorViewsMegabytes = atoi(argv[i]);
+            
+            if (sensorViewsMegabytes < 0)
+            {
+                cerr << "camera view memory cannot be negative." << endl;
+                exit(0);
+            }
+        }
+        
+        // -bench [int]: evaluate the given number of agents after a warm-up generation,
+        // report the time and heap allocations per evaluation and exit
+        else if (strcmp(argv[i], "-bench") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            benchmarkEvaluations = atoi(argv[i]);
+            
+            if (benchmarkEvaluations < 1)
+            {
+                cerr << "minimum number of benchmark evaluations is 1." << endl;
+                exit(0);
+            }
+        }
+        
+        // -gb: save genomes in the binary format instead of as text
+        // (genome files of either format can be loaded)
+        else if (strcmp(argv[i], "-gb") == 0)
+        {
+            binaryGenomes = true;
+        }
+        
+        // -checkpoint [int] [out file name]: save the whole run to the given file every [int] generations
+        else if (strcmp(argv[i], "-checkpoint") == 0 && (i + 2) < argc)
+        {
+            ++i;
+            checkpointFrequency = atoi(argv[i]);
+            ++i;
+            checkpointFileName = argv[i];
+            
+            if (checkpointFrequency < 1)
+            {
+                cerr << "minimum checkpoint frequency is 1." << endl;
+                exit(0);
+            }
+            
+            cout << "checkpoint every " << checkpointFrequency << " generations to " << checkpointFileName << endl;
+        }
+        
+        // -resume [in file name]: continue the run saved in the given checkpoint file
+        else if (strcmp(argv[i], "-resume") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            resumeFileName = argv[i];
+        }
+        
+        // -islands [int] [int]: evolve the given number of populations, each on its own thread,
+        // and send copies of the best agents of every island to the next one every [int] generations
+        else if (strcmp(argv[i], "-islands") == 0 && (i + 2) < argc)
+        {
+            ++i;
+            nrOfIslands = atoi(argv[i]);
+            ++i;
+            migrationFrequency = atoi(argv[i]);
+            
+            if (nrOfIslands < 2)
+            {
+                cerr << "minimum number of islands is 2." << endl;
+                exit(0);
+            }
+            
+            if (migrationFrequency < 1)
+            {
+                cerr << "minimum migration frequency is 1." << endl;
+                exit(0);
+            }
+            
+            cout << nrOfIslands << " islands with migration every " << migrationFrequency << " generations" << endl;
+        }
+        
+        // -nocache: test every agent every generation, even when its fitness is known from the last one
+        else if (strcmp(argv[i], "-nocache") == 0)
+        {
+            fitnessCaching = false;
+        }
+        
+        // -data [in file name]: read the digits from the given text or binary digit file
+        else if (strcmp(argv[i], "-data") == 0 && (i + 1) < argc)
+        {
+            ++i;
+            datasetFileName = argv[i];
+            cout << "digit file set to: " << datasetFileName << endl;
+        }
+    }
+    
+    if (nrOfIslands > 0 && (checkpointFrequency > 0 || resumeFileName != ""))
+    {
+        cerr << "-checkpoint and -resume cannot be combined with -islands." << endl;
+        exit(0);
+    }
+    
+    // a resumed run continues with the settings it was started with
+    if (resumeFileName != "")
+    {
+        if (!checkpoint.read(resumeFileName.c_str()) || !readCheckpointOptions(LODFileName, eddGenomeFileName, generationsSet))
+        {
+            cerr << "could not resume from " << resumeFileName << endl;
+            exit(0);
+        }
     }
     
     // set up the simulation
-    game = new tGame(gridSizeX, gridSizeY);
+    game = new tGame(datasetFileName.c_str(), gridSizeX, gridSizeY);
+    
+    if (game->dataset.nrOfImages == 0)
+    {
+        cerr << "could not load any digits from " << datasetFileName << endl;
+        exit(0);
+    }
+    
+    threadPool = new tThreadPool(nrOfThreads);
+    if (!game->buildSensorViews(gridSizeX, gridSizeY, zoomingCamera || randomStart, (size_t)sensorViewsMegabytes << 20, threadPool))
+    {
+        cout << "precomputed camera views would take more than " << sensorViewsMegabytes << " MB, reading the sensors from the digits instead" << endl;
+    }
+    game->setupThreads(max(threadPool->size(), nrOfIslands));
     
     if (display_only)
     {
@@ -332,7 +660,12 @@ int main(int argc, char *argv[])
             {
                 cout << "building video for run " << it->first << endl;
                 
-                eddAgent->loadAgent((char *)it->second[0].c_str());
+                if (!eddAgent->loadAgent(it->second[0].c_str()))
+                {
+                    cerr << "could not load genome file " << it->second[0] << endl;
+                    ++it;
+                    continue;
+                }
                 
                 string bestString = findBestRun(eddAgent);
                 
@@ -364,140 +697,99 @@ int main(int argc, char *argv[])
         exit(0);
     }
     
-    // seed the agents
-    delete eddAgent;
-    eddAgent = new tAgent;
-    eddAgent->setupRandomAgent(10000);
-    //eddAgent->loadAgent("run17agent.genome-gen1000000");
+    if (benchmarkEvaluations > 0)
+    {
+        benchmark(benchmarkEvaluations);
+        exit(0);
+    }
     
-    // make mutated copies of the start genome to fill up the initial population
-	for(int i = 0; i < populationSize; ++i)
+    // a single population on the thread pool, or one population per island each on a thread of its own
+    vector<tIsland> islands(max(nrOfIslands, 1));
+    int firstGeneration = 1;
+    
+    for (int i = 0; i < (int)islands.size(); ++i)
     {
-		eddAgents[i] = new tAgent;
-		eddAgents[i]->inherit(eddAgent, 0.01, 1, false);
+        setupIsland(islands[i], i);
     }
     
-	EANextGen.resize(populationSize);
+    // the islands form a ring, every island sends its migrants to the next one
+    for (int i = 0; i < nrOfIslands; ++i)
+    {
+        islands[i].incoming = islands[(i + nrOfIslands - 1) % nrOfIslands].outgoing;
+    }
     
-	eddAgent->nrPointingAtMe--;
+    if (resumeFileName != "")
+    {
+        int lastGeneration = 0;
+        
+        if (!readCheckpointRun(lastGeneration, islands[0]))
+        {
+            cerr << "could not resume from " << resumeFileName << endl;
+            exit(0);
+        }
+        
+        firstGeneration = lastGeneration + 1;
+        cout << "resuming after generation " << lastGeneration << endl;
+    }
+    else
+    {
+        for (int i = 0; i < (int)islands.size(); ++i)
+        {
+            seedIsland(islands[i]);
+        }
+    }
     
 	cout << "setup complete" << endl;
     cout << "starting evolution" << endl;
     
-    // main loop
-	for (int update = 1; update <= totalGenerations; ++update)
+    if (nrOfIslands == 0)
     {
-        // reset fitnesses
-		for(int i = 0; i < populationSize; ++i)
+        // main loop
+        for (int update = firstGeneration; update <= totalGenerations; ++update)
         {
-			eddAgents[i]->fitness = 0.0;
-			//eddAgents[i]->fitnesses.clear();
-		}
-        
-        // determine fitness of population
-		eddMaxFitness = 0.0;
-        double eddAvgFitness = 0.0;
-        int eddMaxIndex = 0;
-        
-		for (int i = 0; i < populationSize; ++i)
-        {
-	  game->executeGame(eddAgents[i], NULL, false, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount);
-            
-            eddAvgFitness += eddAgents[i]->classificationFitness;
-            
-            //eddAgents[i]->fitnesses.push_back(eddAgents[i]->fitness);
+            evolveGeneration(islands[0], update, eddGenomeFileName);
             
-            if(eddAgents[i]->classificationFitness > eddMaxFitness)
+            if (checkpointFrequency > 0 && update % checkpointFrequency == 0)
             {
-                eddMaxFitness = eddAgents[i]->classificationFitness;
-                eddMaxIndex = i;
+                writeCheckpoint(update, LODFileName, eddGenomeFileName, islands[0]);
             }
-		}
-        
-        eddAvgFitness /= (double)populationSize;
-        
-        // make a copy of the best agent
-        if (bestEddAgent != NULL)
-        {
-            delete bestEddAgent;
-        }
-        bestEddAgent = new tAgent;
-        bestEddAgent->inherit(eddAgents[eddMaxIndex], 0.0, update, false);
-        bestEddAgent->setupPhenotype();
-		
-        if (update % 1000 == 0)
-        {
-            cout << "gen " << update << ": edd [" << eddAvgFitness << " : " << eddMaxFitness << "] [genome: " << bestEddAgent->genome.size() << "] [gates: " << bestEddAgent->hmmus.size() << "]" << endl;
         }
+    }
+    else
+    {
+        vector<thread> islandThreads;
         
-        // display video of simulation
-        if (make_interval_video)
+        for (int i = 0; i < nrOfIslands; ++i)
         {
-            bool finalGeneration = (update == totalGenerations);
-            
-            if (update % make_video_frequency == 0 || finalGeneration)
+            islandThreads.push_back(thread([&, i]()
             {
-	      string bestString = game->executeGame(bestEddAgent, NULL, true, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount);
-                
-                if (finalGeneration)
+                for (int update = 1; update <= totalGenerations; ++update)
                 {
-                    bestString.append("X");
+                    evolveGeneration(islands[i], update, eddGenomeFileName);
                 }
-            }
+            }));
         }
         
-        // randomly shuffle the agents
-        random_shuffle(eddAgents.begin(), eddAgents.end());
-        
-		for(int i = 0; i < populationSize; i += 2)
-		{
-            // construct swarm agent population for the next generation
-			tAgent *offspring1 = new tAgent;
-            tAgent *offspring2 = new tAgent;
-            
-            if (eddAgents[i]->fitness > eddAgents[i + 1]->fitness)
-            {
-                offspring1->inherit(eddAgents[i], 0.0, update, false);
-                offspring2->inherit(eddAgents[i], perSiteMutationRate, update, false);
-            }
-            else
-            {
-                offspring1->inherit(eddAgents[i + 1], 0.0, update, false);
-                offspring2->inherit(eddAgents[i + 1], perSiteMutationRate, update, false);
-            }
-			
-			EANextGen[i] = offspring1;
-            EANextGen[i + 1] = offspring2;
-		}
-        
-        // shuffle the populations so there is a minimal chance of the same predator/prey combo in the next generation
-        random_shuffle(EANextGen.begin(), EANextGen.end());
-        
-		for(int i = 0; i < populationSize; ++i)
+        for (int i = 0; i < nrOfIslands; ++i)
         {
-            // replace the edd agents from the previous generation
-			eddAgents[i]->nrPointingAtMe--;
-			if(eddAgents[i]->nrPointingAtMe == 0)
-            {
-				delete eddAgents[i];
-            }
-			eddAgents[i] = EANextGen[i];
-		}
-        
-		eddAgents = EANextGen;
-        
-        if (track_best_brains && update % track_best_brains_frequency == 0)
+            islandThreads[i].join();
+        }
+    }
+    
+    checkpoint.wait();
+    
+    // the best agent of the last generation over all islands
+    for (int i = 0; i < (int)islands.size(); ++i)
+    {
+        if (bestEddAgent == NULL || islands[i].maxFitness > eddMaxFitness)
         {
-            stringstream ess;
-            
-            ess << eddGenomeFileName << "-gen" << update;
-            
-            bestEddAgent->saveGenome(ess.str().c_str());
+            bestEddAgent = islands[i].bestAgent;
+            eddMaxFitness = islands[i].maxFitness;
         }
-	}
+    }
 	
     // save the genome file of the best agent
-	bestEddAgent->saveGenome(eddGenomeFileName.c_str());
+	saveGenome(bestEddAgent, eddGenomeFileName.c_str(), eddMaxFitness);
     
     // save video and quantitative stats on the best swarm agent's LOD
     vector<tAgent*> saveLOD;
@@ -524,10 +816,12 @@ int main(int argc, char *argv[])
     
     cout << "analyzing ancestor list" << endl;
     
+    tRNG rng(masterRNG.next());
+    
     for (vector<tAgent*>::iterator it = saveLOD.begin(); it != saveLOD.end(); ++it)
     {
         // collect quantitative stats
-      game->executeGame(*it, LOD, false, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount);
+      game->executeGame(*it, rng, LOD, false, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount, NULL, 0);
         
         // make video
         if (make_LOD_video)
@@ -550,10 +844,11 @@ string findBestRun(tAgent *eddAgent)
 {
     string reportString = "", bestString = "";
     double bestFitness = 0.0;
+    tRNG rng(masterRNG.next());
     
     for (int rep = 0; rep < 100; ++rep)
     {
-      reportString = game->executeGame(eddAgent, NULL, true, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount);
+      reportString = game->executeGame(eddAgent, rng, NULL, true, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount, NULL, 0);
         
         if (eddAgent->fitness > bestFitness)
         {
@@ -564,3 +859,601 @@ string findBestRun(tAgent *eddAgent)
     
     return bestString;
 }
+
+// set up an empty island: the single population draws from masterRNG and evaluates on the thread pool,
+// an island of -islands draws from a stream of its own and evaluates on its own thread
+void setupIsland(tIsland &island, int index)
+{
+    island.index = index;
+    island.agents.resize(populationSize, NULL);
+    island.nextGeneration.resize(populationSize, NULL);
+    island.bestAgent = NULL;
+    island.maxFitness = 0.0;
+    island.incoming = NULL;
+    island.outgoing = NULL;
+    
+    for (int digit = 0; digit < game->dataset.nrOfImages; ++digit)
+    {
+        island.allDigits.push_back(digit);
+    }
+    
+    if (nrOfIslands == 0)
+    {
+        island.rng = &masterRNG;
+        island.thread = -1;
+    }
+    else
+    {
+        island.rng = new tRNG(masterRNG.next());
+        island.thread = index;
+        // an island is at most one migration ahead of the next, so two batches of migrants can be on the way
+        island.outgoing = new tAgentQueue(2 * nrOfMigrants);
+    }
+}
+
+// fill the island with mutated copies of a random start genome
+void seedIsland(tIsland &island)
+{
+    tAgent *eddAgent = new tAgent;
+    eddAgent->rng.seed(island.rng->next());
+    eddAgent->setupRandomAgent(10000);
+    //eddAgent->loadAgent("run17agent.genome-gen1000000");
+    
+    // make mutated copies of the start genome to fill up the initial population
+    for(int i = 0; i < populationSize; ++i)
+    {
+        island.agents[i] = new tAgent;
+        island.agents[i]->inherit(eddAgent, 0.01, 1, false);
+    }
+    
+    eddAgent->nrPointingAtMe--;
+}
+
+// run the island's agents through the given job, on the thread pool or on the island's own thread
+void forEachAgent(tIsland &island, int count, const function<void(int, int)> &job)
+{
+    if (island.thread < 0)
+    {
+        threadPool->parallelFor(count, job);
+    }
+    else
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            job(i, island.thread);
+        }
+    }
+}
+
+// evaluate the island's population and replace it by the next generation
+void evolveGeneration(tIsland &island, int update, const string &genomeFileName)
+{
+    vector<tAgent*> &eddAgents = island.agents;
+    vector<tAgent*> &EANextGen = island.nextGeneration;
+    vector<int> &allDigits = island.allDigits;
+    tRNG &rng = *island.rng;
+    // the best agent's extra evaluations run on the island's thread
+    int thread = max(island.thread, 0);
+    
+    // reset fitnesses
+    for(int i = 0; i < populationSize; ++i)
+    {
+        eddAgents[i]->fitness = 0.0;
+        //eddAgents[i]->fitnesses.clear();
+    }
+    
+    // determine fitness of population
+    island.maxFitness = 0.0;
+    double eddAvgFitness = 0.0;
+    int eddMaxIndex = 0;
+    
+    // draw this generation's batch, so all agents compete on the same digits
+    vector<int> *batch = NULL;
+    
+    if (batchSize > 0 && batchSize < (int)allDigits.size())
+    {
+        for (int i = 0; i < batchSize; ++i)
+        {
+            int j = i + (int)rng.nextInt((unsigned int)(allDigits.size() - i));
+            swap(allDigits[i], allDigits[j]);
+        }
+        
+        island.batchDigits.assign(allDigits.begin(), allDigits.begin() + batchSize);
+        batch = &island.batchDigits;
+    }
+    
+    // randomly shuffle the agents; neighbors compete in the tournaments below
+    rng.shuffle(eddAgents);
+    
+    // every agent is evaluated on its own random stream,
+    // so the results do not depend on the number of threads or their timing
+    if (raceChunkSize > 0)
+    {
+        forEachAgent(island, populationSize / 2, [&](int pair, int thread)
+        {
+            game->raceGames(eddAgents[2 * pair], eddAgents[2 * pair + 1], raceChunkSize, gridSizeX, gridSizeY, zoomingCamera, randomStart, batch, thread);
+        });
+    }
+    else
+    {
+        // the fitness of a brain tested in the last generation is only known for sure
+        // when the agents are tested on the same digits the same way every generation
+        bool cached = fitnessCaching && !randomStart && !noise && batch == NULL;
+#ifdef feedbackON
+        cached = false;
+#endif
+        forEachAgent(island, populationSize, [&](int i, int thread)
+        {
+            tAgent *agent = eddAgents[i];
+            double fitness, classificationFitness;
+            
+            if (cached)
+            {
+                agent->setupPhenotype();
+                
+                if (agent->brain->allDeterministic && island.fitnessCache.find(agent->brain.get(), fitness, classificationFitness))
+                {
+                    game->skipGame(agent, agent->rng, batch, fitness, classificationFitness, thread);
+                    return;
+                }
+            }
+            
+            game->executeGame(agent, agent->rng, NULL, false, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount, batch, thread);
+        });
+        
+        if (cached)
+        {
+            island.fitnessCache.store(eddAgents);
+        }
+    }
+    
+    for (int i = 0; i < populationSize; ++i)
+    {
+        // when racing, only the tournament winners are evaluated on all digits,
+        // so the average is taken over them
+        if (raceChunkSize == 0)
+        {
+            eddAvgFitness += eddAgents[i]->classificationFitness;
+        }
+        else if (i % 2 == 0)
+        {
+            int winner = (eddAgents[i]->fitness > eddAgents[i + 1]->fitness) ? i : i + 1;
+            eddAvgFitness += eddAgents[winner]->classificationFitness;
+        }
+        
+        //eddAgents[i]->fitnesses.push_back(eddAgents[i]->fitness);
+        
+        if(eddAgents[i]->classificationFitness > island.maxFitness)
+        {
+            island.maxFitness = eddAgents[i]->classificationFitness;
+            eddMaxIndex = i;
+        }
+    }
+    
+    eddAvgFitness /= (raceChunkSize == 0) ? (double)populationSize : (double)(populationSize / 2);
+    
+    // make a copy of the best agent
+    if (island.bestAgent != NULL)
+    {
+        island.bestAgent->recycle();
+    }
+    else
+    {
+        island.bestAgent = new tAgent;
+    }
+    tAgent *bestEddAgent = island.bestAgent;
+    bestEddAgent->inherit(eddAgents[eddMaxIndex], 0.0, update, false);
+    bestEddAgent->setupPhenotype();
+    
+    if (update % 1000 == 0)
+    {
+        lock_guard<mutex> guard(outputLock);
+        cout << "gen " << update << islandName(island) << ": edd [" << eddAvgFitness << " : " << island.maxFitness << "] [genome: " << bestEddAgent->genome.size() << "] [gates: " << bestEddAgent->brain->hmmus.size() << "]" << endl;
+    }
+    
+    // the batch fitness is only an estimate; check the best agent against all digits now and then
+    if (batch != NULL && fullEvaluationFrequency > 0 && (update % fullEvaluationFrequency == 0 || update == totalGenerations))
+    {
+        tRNG fullRNG(rng.next());
+        game->executeGame(bestEddAgent, fullRNG, NULL, false, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount, NULL, thread);
+        lock_guard<mutex> guard(outputLock);
+        cout << "gen " << update << islandName(island) << ": best edd on all " << allDigits.size() << " digits [" << bestEddAgent->classificationFitness << "]" << endl;
+    }
+    
+    // display video of simulation
+    if (make_interval_video)
+    {
+        bool finalGeneration = (update == totalGenerations);
+        
+        if (update % make_video_frequency == 0 || finalGeneration)
+        {
+            tRNG videoRNG(rng.next());
+            string bestString = game->executeGame(bestEddAgent, videoRNG, NULL, true, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount, NULL, thread);
+            
+            if (finalGeneration)
+            {
+                bestString.append("X");
+            }
+        }
+    }
+    
+    bool migration = (island.outgoing != NULL) && (update % migrationFrequency == 0) && (update < totalGenerations);
+    
+    // copies of the best agents leave for the next island before the offspring are made
+    if (migration)
+    {
+        sendMigrants(island, update);
+    }
+    
+    for(int i = 0; i < populationSize; i += 2)
+    {
+        // construct swarm agent population for the next generation
+        tAgent *offspring1 = newAgent(island);
+        tAgent *offspring2 = newAgent(island);
+        
+        if (eddAgents[i]->fitness > eddAgents[i + 1]->fitness)
+        {
+            offspring1->inherit(eddAgents[i], 0.0, update, false);
+            offspring2->inherit(eddAgents[i], perSiteMutationRate, update, false);
+        }
+        else
+        {
+            offspring1->inherit(eddAgents[i + 1], 0.0, update, false);
+            offspring2->inherit(eddAgents[i + 1], perSiteMutationRate, update, false);
+        }
+        
+        EANextGen[i] = offspring1;
+        EANextGen[i + 1] = offspring2;
+    }
+    
+    // shuffle the populations so there is a minimal chance of the same predator/prey combo in the next generation
+    rng.shuffle(EANextGen);
+    
+    // the previous island's migrants take the places of random offspring
+    if (migration)
+    {
+        receiveMigrants(island);
+    }
+    
+    for(int i = 0; i < populationSize; ++i)
+    {
+        // replace the edd agents from the previous generation
+        retireAgent(island, eddAgents[i]);
+        eddAgents[i] = EANextGen[i];
+    }
+    
+    if (track_best_brains && update % track_best_brains_frequency == 0)
+    {
+        stringstream ess;
+        
+        ess << genomeFileName << islandFileName(island) << "-gen" << update;
+        
+        saveGenome(bestEddAgent, ess.str().c_str(), island.maxFitness);
+    }
+}
+
+// " island [index]" when running islands, so output lines and files of different islands can be told apart
+string islandName(tIsland &island)
+{
+    stringstream name;
+    
+    if (nrOfIslands > 0)
+    {
+        name << " island " << island.index;
+    }
+    
+    return name.str();
+}
+
+string islandFileName(tIsland &island)
+{
+    stringstream name;
+    
+    if (nrOfIslands > 0)
+    {
+        name << "-island" << island.index;
+    }
+    
+    return name.str();
+}
+
+// send copies of the island's fittest agents of this generation to the next island;
+// ties go to the agent that comes first, so the choice only depends on the island's own run
+void sendMigrants(tIsland &island, int update)
+{
+    vector<int> &ranking = island.ranking;
+    
+    ranking.resize(populationSize);
+    
+    for (int i = 0; i < populationSize; ++i)
+    {
+        ranking[i] = i;
+    }
+    
+    partial_sort(ranking.begin(), ranking.begin() + nrOfMigrants, ranking.end(), [&](int a, int b)
+    {
+        return island.agents[a]->fitness > island.agents[b]->fitness || (island.agents[a]->fitness == island.agents[b]->fitness && a < b);
+    });
+    
+    for (int i = 0; i < nrOfMigrants; ++i)
+    {
+        tAgent *migrant = newAgent(island);
+        migrant->inherit(island.agents[ranking[i]], 0.0, update, false);
+        
+        // the next island may still be busy with the previous migration
+        while (!island.outgoing->push(migrant))
+        {
+            this_thread::yield();
+        }
+    }
+}
+
+// wait for the migrants the previous island sent in the same generation;
+// every island sends before it waits, so the ring of islands cannot deadlock,
+// and the outcome does not depend on how fast the islands run
+void receiveMigrants(tIsland &island)
+{
+    for (int i = 0; i < nrOfMigrants; ++i)
+    {
+        tAgent *migrant;
+        
+        while ((migrant = island.incoming->pop()) == NULL)
+        {
+            this_thread::yield();
+        }
+        
+        retireAgent(island, island.nextGeneration[i]);
+        island.nextGeneration[i] = migrant;
+    }
+}
+
+// an agent to inherit into, recycled from an earlier generation when possible
+// (together with its genome and other buffers, so the next generation needs no new memory)
+tAgent *newAgent(tIsland &island)
+{
+    if (island.spareAgents.empty())
+    {
+        return new tAgent;
+    }
+    
+    tAgent *agent = island.spareAgents.back();
+    island.spareAgents.pop_back();
+    return agent;
+}
+
+
+// let go of an agent; once nothing points at it anymore it is recycled
+void retireAgent(tIsland &island, tAgent *agent)
+{
+    agent->nrPointingAtMe--;
+    
+    if (agent->nrPointingAtMe == 0)
+    {
+        agent->recycle();
+        island.spareAgents.push_back(agent);
+    }
+}
+
+void benchmark(int evaluations)
+{
+    vector<tAgent*> agents(populationSize);
+    tAgent *ancestor = new tAgent;
+    
+    ancestor->rng.seed(masterRNG.next());
+    ancestor->setupRandomAgent(10000);
+    
+    for (int i = 0; i < populationSize; ++i)
+    {
+        agents[i] = new tAgent;
+        agents[i]->inherit(ancestor, 0.01, 1, false);
+    }
+    
+    function<void(int, int)> evaluate = [&](int i, int thread)
+    {
+        tAgent *agent = agents[i % populationSize];
+        game->executeGame(agent, agent->rng, NULL, false, gridSizeX, gridSizeY, zoomingCamera, randomStart, noise, noiseAmount, NULL, thread);
+    };
+    
+    // warm-up: decode every brain and grow the scratch buffers to size
+    threadPool->parallelFor(populationSize, evaluate);
+    
+#ifdef countAllocations
+    unsigned long allocationsBefore = heapAllocations;
+#endif
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    threadPool->parallelFor(evaluations, evaluate);
+    
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#ifdef countAllocations
+    unsigned long allocations = heapAllocations - allocationsBefore;
+#endif
+    
+    cout << evaluations << " evaluations on " << game->dataset.nrOfImages << " digits in " << seconds << " s ("
+         << 1000.0 * seconds / evaluations << " ms per evaluation)" << endl;
+    
+#ifdef countAllocations
+    cout << allocations << " heap allocations (" << (double)allocations / evaluations << " per evaluation)" << endl;
+#endif
+}
+
+// save the agent's genome as text, or with -gb in the binary format together with
+// the generation it was saved in, its fitness and the run options it was evolved with
+void saveGenome(tAgent *agent, const char *filename, double fitness)
+{
+    if (!binaryGenomes)
+    {
+        agent->saveGenome(filename);
+        return;
+    }
+    
+    tGenomeHeader header;
+    
+    memset(&header, 0, sizeof(header));
+    header.generation = agent->born;
+    header.fitness = fitness;
+    header.options = (zoomingCamera ? genomeZoomingCamera : 0) | (randomStart ? genomeRandomStart : 0) | (noise ? genomeNoise : 0);
+    header.gridSizeX = gridSizeX;
+    header.gridSizeY = gridSizeY;
+    header.noiseAmount = noiseAmount;
+    
+    if (!agent->saveGenomeBinary(filename, header))
+    {
+        cerr << "could not write genome file " << filename << endl;
+    }
+}
+
+// everything the next generations depend on goes into the checkpoint: the settings that change the results,
+// the random streams, the order of the digits the batches are drawn from, the population and the best agent so far.
+// the checkpoint is assembled here and written to disk in the background while evolution goes on
+void writeCheckpoint(int update, const string &LODFileName, const string &genomeFileName, tIsland &population)
+{
+    vector<tAgent*> &agents = population.agents;
+    vector<int> &allDigits = population.allDigits;
+    
+    // the previous write has to be done before its buffer is refilled
+    checkpoint.wait();
+    checkpoint.clear();
+    
+    checkpoint.put(populationSize);
+    checkpoint.put(totalGenerations);
+    checkpoint.put(perSiteMutationRate);
+    checkpoint.put(gridSizeX);
+    checkpoint.put(gridSizeY);
+    checkpoint.put(zoomingCamera);
+    checkpoint.put(randomStart);
+    checkpoint.put(noise);
+    checkpoint.put(noiseAmount);
+    checkpoint.put(batchSize);
+    checkpoint.put(fullEvaluationFrequency);
+    checkpoint.put(raceChunkSize);
+    checkpoint.put(make_interval_video);
+    checkpoint.put(make_video_frequency);
+    checkpoint.putString(datasetFileName);
+    checkpoint.putString(LODFileName);
+    checkpoint.putString(genomeFileName);
+    checkpoint.put(checkpointFrequency);
+    checkpoint.putString(checkpointFileName);
+    checkpoint.put(binaryGenomes);
+    checkpoint.put(fitnessCaching);
+    
+    checkpoint.put(update);
+    checkpoint.put(masterRNG.s);
+    checkpoint.put((int)allDigits.size());
+    checkpoint.putBytes(&allDigits[0], allDigits.size() * sizeof(int));
+    checkpoint.put(population.maxFitness);
+    
+    // the best agent, then the population in order
+    for (int i = -1; i < (int)agents.size(); ++i)
+    {
+        tAgent *agent = (i == -1) ? population.bestAgent : agents[i];
+        
+        checkpoint.put(agent->born);
+        checkpoint.put(agent->rng.s);
+        checkpoint.put((int)agent->genome.size());
+        checkpoint.putBytes(&agent->genome[0], agent->genome.size());
+    }
+    
+    checkpoint.writeAsync(checkpointFileName);
+}
+
+// restore the settings of the checkpointed run; output file names, -g and -checkpoint
+// given on the command line take precedence over the ones of the checkpoint
+bool readCheckpointOptions(string &LODFileName, string &genomeFileName, bool keepGenerations)
+{
+    int generations = 0, frequency = 0;
+    string LODName, genomeName, checkpointName;
+    
+    bool ok = checkpoint.get(populationSize)
+        && checkpoint.get(generations)
+        && checkpoint.get(perSiteMutationRate)
+        && checkpoint.get(gridSizeX)
+        && checkpoint.get(gridSizeY)
+        && checkpoint.get(zoomingCamera)
+        && checkpoint.get(randomStart)
+        && checkpoint.get(noise)
+        && checkpoint.get(noiseAmount)
+        && checkpoint.get(batchSize)
+        && checkpoint.get(fullEvaluationFrequency)
+        && checkpoint.get(raceChunkSize)
+        && checkpoint.get(make_interval_video)
+        && checkpoint.get(make_video_frequency)
+        && checkpoint.getString(datasetFileName)
+        && checkpoint.getString(LODName)
+        && checkpoint.getString(genomeName)
+        && checkpoint.get(frequency)
+        && checkpoint.getString(checkpointName)
+        && checkpoint.get(binaryGenomes)
+        && checkpoint.get(fitnessCaching);
+    
+    if (!ok)
+    {
+        return false;
+    }
+    
+    if (!keepGenerations)
+    {
+        totalGenerations = generations;
+    }
+    
+    if (LODFileName == "")
+    {
+        LODFileName = LODName;
+        genomeFileName = genomeName;
+    }
+    
+    if (checkpointFileName == "")
+    {
+        checkpointFrequency = frequency;
+        checkpointFileName = checkpointName;
+    }
+    
+    return true;
+}
+
+// restore the state of the checkpointed run at the end of the generation it was saved in
+bool readCheckpointRun(int &update, tIsland &population)
+{
+    vector<tAgent*> &agents = population.agents;
+    vector<int> &allDigits = population.allDigits;
+    int nrOfDigits = 0;
+    
+    if (!checkpoint.get(update) || !checkpoint.get(masterRNG.s) || !checkpoint.get(nrOfDigits) || nrOfDigits != (int)allDigits.size())
+    {
+        return false;
+    }
+    
+    if (!checkpoint.getBytes(&allDigits[0], allDigits.size() * sizeof(int)) || !checkpoint.get(population.maxFitness))
+    {
+        return false;
+    }
+    
+    for (int i = -1; i < populationSize; ++i)
+    {
+        tAgent *agent = new tAgent;
+        int length = 0;
+        
+        if (!checkpoint.get(agent->born) || !checkpoint.get(agent->rng.s) || !checkpoint.get(length) || length <= 0)
+        {
+            return false;
+        }
+        
+        agent->genome.resize(length);
+        
+        if (!checkpoint.getBytes(&agent->genome[0], length))
+        {
+            return false;
+        }
+        
+        if (i == -1)
+        {
+            population.bestAgent = agent;
+        }
+        else
+        {
+            agents[i] = agent;
+        }
+    }
+    
+    return true;
+}
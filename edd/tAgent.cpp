@@ -21,32 +21,41 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <map>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tAgent.h"
 #include "globalConst.h"
 
 tAgent::tAgent(){
 	nrPointingAtMe=1;
 	ancestor = NULL;
-	for(int i=0;i<maxNodes;i++)
-    {
-		states[i]=0;
-		newStates[i]=0;
-	}
-	ID=masterID;
-	masterID++;
-	hmmus.clear();
+	states=0;
+	ID=masterID++;
 	nrOfOffspring=0;
 }
 
 tAgent::~tAgent()
 {
-	for (int i = 0; i < hmmus.size(); ++i)
+	if (ancestor!=NULL)
     {
-        delete hmmus[i];
-    }
-    
+		ancestor->nrPointingAtMe--;
+		if (ancestor->nrPointingAtMe == 0)
+        {
+			delete ancestor;
+        }
+	}
+}
+
+// turn an agent nobody points at anymore into a fresh one, keeping its genome and other buffers
+// so inheriting into it again does not have to allocate them
+void tAgent::recycle(void)
+{
 	if (ancestor!=NULL)
     {
 		ancestor->nrPointingAtMe--;
@@ -55,6 +64,14 @@ tAgent::~tAgent()
 			delete ancestor;
         }
 	}
+	nrPointingAtMe=1;
+	ancestor = NULL;
+	states=0;
+	ID=masterID++;
+	nrOfOffspring=0;
+	fitnesses.clear();
+	brain.reset();
+	parentBrain.reset();
 }
 
 void tAgent::setupRandomAgent(int nucleotides)
@@ -63,34 +80,89 @@ void tAgent::setupRandomAgent(int nucleotides)
 	genome.resize(nucleotides);
 	for(i=0;i<nucleotides;i++)
 		genome[i]=127;//rand()&255;
+	brain.reset();
+	parentBrain.reset();
 	ampUpStartCodons();
     //setupPhenotype();
 }
-void tAgent::loadAgent(char* filename)
+// load a genome file in either format: binary files are recognized by their header,
+// anything else is read as tab-separated numbers; the header of a binary file is
+// copied into header if given (a text file leaves header->version at 0)
+bool tAgent::loadAgent(const char* filename, tGenomeHeader *header)
 {
-	FILE *f=fopen(filename,"r+t");
-	int i;
+	int file=open(filename,O_RDONLY);
+	struct stat status;
+	if(header!=NULL)
+		memset(header,0,sizeof(tGenomeHeader));
+	if(file<0)
+		return false;
+	if((fstat(file,&status)!=0)||(status.st_size==0)){
+		close(file);
+		return false;
+	}
+	size_t size=(size_t)status.st_size;
+	void *mapping=mmap(NULL,size,PROT_READ,MAP_PRIVATE,file,0);
+	close(file);
+	if(mapping==MAP_FAILED)
+		return false;
+	const unsigned char *bytes=(const unsigned char*)mapping;
+	const tGenomeHeader *fileHeader=(const tGenomeHeader*)mapping;
+	bool ok=true;
 	genome.clear();
-	while(!(feof(f)))
-    {
-		fscanf(f,"%i	",&i);
-		genome.push_back((unsigned char)(i&255));
+	if((size>=sizeof(tGenomeHeader))&&(memcmp(fileHeader->magic,genomeMagic,sizeof(fileHeader->magic))==0)){
+		if((fileHeader->version!=genomeVersion)||(size<sizeof(tGenomeHeader)+fileHeader->length)){
+			fprintf(stderr,"unsupported or truncated genome file: %s\n",filename);
+			ok=false;
+		}
+		else{
+			genome.assign(bytes+sizeof(tGenomeHeader),bytes+sizeof(tGenomeHeader)+fileHeader->length);
+			if(header!=NULL)
+				*header=*fileHeader;
+		}
+	}
+	else{
+		// same as reading "%i\t" until the end of the file, without a library call per number
+		size_t i=0;
+		while(i<size){
+			while((i<size)&&isspace(bytes[i]))
+				i++;
+			if(i==size)
+				break;
+			bool negative=(bytes[i]=='-');
+			if((bytes[i]=='-')||(bytes[i]=='+'))
+				i++;
+			if((i==size)||!isdigit(bytes[i])){
+				fprintf(stderr,"invalid genome file: %s\n",filename);
+				ok=false;
+				break;
+			}
+			int value=0;
+			while((i<size)&&isdigit(bytes[i]))
+				value=value*10+(bytes[i++]-'0');
+			genome.push_back((unsigned char)((negative?-value:value)&255));
+		}
 	}
+	munmap(mapping,size);
+	brain.reset();
+	parentBrain.reset();
 	//setupPhenotype();
+	return ok&&!genome.empty();
 }
 
 void tAgent::ampUpStartCodons(void)
 {
 	int i,j;
+	brain.reset();
+	parentBrain.reset();
 	for(i=0;i<genome.size();i++)
-		genome[i]=rand()&255;
+		genome[i]=rng.next()&255;
 	for(i=0;i<20;i++)
 	{
-		j=rand()%((int)genome.size()-100);
+		j=rng.nextInt((int)genome.size()-100);
 		genome[j]=42;
 		genome[j+1]=(255-42);
 		for(int k=2;k<20;k++)
-			genome[j+k]=rand()&255;
+			genome[j+k]=rng.next()&255;
 	}
 }
 
@@ -99,19 +171,28 @@ void tAgent::inherit(tAgent *from, double mutationRate, int theTime, bool evolve
 	int nucleotides=(int)from->genome.size();
 	int i,s,o,w;
 	//double localMutationRate=4.0/from->genome.size();
-	vector<unsigned char> buffer;
+	vector<unsigned char> &buffer=duplicationBuffer;
+	bool mutated=false;
 	born=theTime;
+	// the offspring continues on its own random stream split off from the parent's
+	rng.seed(from->rng.next());
 	//ancestor=from;
 	//from->nrPointingAtMe++;
 	//from->nrOfOffspring++;
 	genome.clear();
 	genome.resize(from->genome.size());
+	edits.reset(nucleotides);
     
 	for(i=0;i<nucleotides;i++)
     {
-		if (randDouble < mutationRate)
+		if (rng.nextDouble() < mutationRate)
         {
-			genome[i]=rand()&255;
+			genome[i]=rng.next()&255;
+			if(genome[i]!=from->genome[i])
+            {
+				mutated=true;
+				edits.pointMutations.push_back(i);
+            }
         }
 		else
         {
@@ -121,96 +202,96 @@ void tAgent::inherit(tAgent *from, double mutationRate, int theTime, bool evolve
     
     if (mutationRate != 0.0)
     {
-        if ( (randDouble < 0.05) && (genome.size() < 10000) )
+        if ( (rng.nextDouble() < 0.05) && (genome.size() < 10000) )
         {
             //duplication
-            w=15+rand()&511;
-            s=rand()%((int)genome.size()-w);
-            o=rand()%(int)genome.size();
+            w=15+(int)(rng.next()>>33)&511;
+            s=rng.nextInt((int)genome.size()-w);
+            o=rng.nextInt((int)genome.size());
             buffer.clear();
             buffer.insert(buffer.begin(),genome.begin()+s,genome.begin()+s+w);
             genome.insert(genome.begin()+o,buffer.begin(),buffer.end());
+            edits.insert(o,w);
+            mutated|=(w>0);
         }
-        if ( (randDouble < 0.02) && (genome.size() > 1000) )
+        if ( (rng.nextDouble() < 0.02) && (genome.size() > 1000) )
         {
             //deletion
-            w=15+rand()&511;
-            s=rand()%((int)genome.size()-w);
+            w=15+(int)(rng.next()>>33)&511;
+            s=rng.nextInt((int)genome.size()-w);
             genome.erase(genome.begin()+s,genome.begin()+s+w);
+            edits.erase(s,w);
+            mutated|=(w>0);
         }
     }
 
+	// an unchanged copy shares the parent's compiled brain,
+	// a mutated one is rebuilt from it the next time setupPhenotype is called
+	brain.reset();
+	parentBrain.reset();
+#ifndef feedbackON
+	if(!mutated)
+		brain=from->brain;
+	else
+		parentBrain=from->brain;
+#endif
 	//setupPhenotype();
 	fitness=0.0;
 }
 
 void tAgent::setupPhenotype(void)
 {
-	int i;
-	tHMMU *hmmu;
-	if(hmmus.size()!=0)
-    {
-		for(i=0;i<hmmus.size();i++)
-        {
-			delete hmmus[i];
-        }
-    }
-	hmmus.clear();
-	for(i=0;i<genome.size();i++)
-    {
-		if((genome[i]==42)&&(genome[(i+1)%genome.size()]==(255-42)))
-        {
-			hmmu=new tHMMU;
-			hmmu->setupDeterministic(genome,i);
-			//hmmu->setup(genome,i);
-			hmmus.push_back(hmmu);
-		}
-        /*
-		if((genome[i]==43)&&(genome[(i+1)%genome.size()]==(255-43))){
-			hmmu=new tHMMU;
-			//hmmu->setup(genome,i);
-			hmmu->setupDeterministic(genome,i);
-			hmmus.push_back(hmmu);
-		}
-         */
-	}
+#ifndef feedbackON
+	// the brain stays valid until the genome changes
+	// (with feedback the gates learn during a run, so every evaluation starts from freshly decoded gates)
+	if(brain)
+		return;
+#endif
+	shared_ptr<tBrain> newBrain=brainPool.get();
+#ifndef feedbackON
+	// after inherit only the gates around the mutated sites have to be decoded again
+	if(parentBrain)
+		newBrain->decode(genome,parentBrain.get(),edits);
+	else
+#endif
+		newBrain->decode(genome);
+	brain=newBrain;
+	parentBrain.reset();
 }
 
 void tAgent::resetBrain(void)
 {
-	for(int i=0;i<maxNodes;i++)
-    {
-		states[i]=0;
-    }
+	states=0;
 }
 
-void tAgent::updateStates(void)
+void tAgent::updateStates(tRNG &rng)
 {
-	for(vector<tHMMU*>::iterator it = hmmus.begin(), end = hmmus.end(); it != end; ++it)
+#ifdef feedbackON
+	uint64_t newStates=0;
+	for(vector<tHMMU>::iterator it = brain->hmmus.begin(), end = brain->hmmus.end(); it != end; ++it)
     {
-		(*it)->update(&states[0],&newStates[0]);
+		it->update(states,newStates,rng);
     }
-    
-	for(int i=0;i<maxNodes;i++)
-    {
-		states[i]=newStates[i];
-		newStates[i]=0;
-	}
+	states=newStates;
+#else
+	states=brain->update(states,rng);
+#endif
 }
 
 void tAgent::showBrain(void)
 {
 	for(int i=0;i<maxNodes;i++)
     {
-		cout<<(int)states[i];
+		cout<<(int)((states>>i)&1);
     }
 	cout<<endl;
 }
 
 void tAgent::showPhenotype(void)
 {
+	vector<tHMMU> &hmmus=brain->hmmus;
 	for(int i=0;i<hmmus.size();i++)
-		hmmus[i]->show();
+		hmmus[i].show();
 	cout<<"------"<<endl;
 }
 
@@ -218,6 +299,7 @@ void tAgent::saveToDot(const char *filename)
 {
 	FILE *f=fopen(filename,"w+t");
 	int i,j,k,node;
+	vector<tHMMU> &hmmus=brain->hmmus;
 	fprintf(f,"digraph brain {\n");
 	fprintf(f,"	ranksep=2.0;\n");
     
@@ -231,14 +313,14 @@ void tAgent::saveToDot(const char *filename)
     
     for(i=0;i<hmmus.size();i++)
     {
-        for(j=0;j<hmmus[i]->ins.size();j++)
+        for(j=0;j<hmmus[i]._yDim;j++)
         {
-            print_node[hmmus[i]->ins[j]] = true;
+            print_node[hmmus[i].ins[j]] = true;
         }
         
-        for(k=0;k<hmmus[i]->outs.size();k++)
+        for(k=0;k<hmmus[i]._xDim;k++)
         {
-            print_node[hmmus[i]->outs[k]] = true;
+            print_node[hmmus[i].outs[k]] = true;
         }
     }
     
@@ -278,11 +360,11 @@ void tAgent::saveToDot(const char *filename)
     // connections
 	for(i=0;i<hmmus.size();i++)
     {
-		for(j=0;j<hmmus[i]->ins.size();j++)
+		for(j=0;j<hmmus[i]._yDim;j++)
         {
-			for(k=0;k<hmmus[i]->outs.size();k++)
+			for(k=0;k<hmmus[i]._xDim;k++)
             {
-				fprintf(f,"	%i	->	%i;\n",hmmus[i]->ins[j],hmmus[i]->outs[k]);
+				fprintf(f,"	%i	->	%i;\n",hmmus[i].ins[j],hmmus[i].outs[k]);
             }
 		}
 	}
@@ -327,6 +409,13 @@ void tAgent::saveLogicTable(const char *filename)
 	int i,j;
     
     fprintf(f,"s0,s1,s2,s3,s4,s5,s6,s7,s8,s9,s10,s11,p15,,o1,o2\n");
+#ifndef feedbackON
+    // the table shows nodes 30 and 31, which are no output nodes, so the brain that is evaluated would leave out
+    // the gates that only lead there; build one that keeps every gate that can reach them
+    tBrain logicBrain;
+    logicBrain.observedNodes |= ((uint64_t)1 << 30) | ((uint64_t)1 << 31);
+    logicBrain.decode(genome);
+#endif
     //fprintf(f,"s11,p12,p13,p14,p15,p16,p17,p18,p19,p20,p21,p22,p23,,o1,o2\n");
     
     for(i = 0; i < (int)pow(2.0, 13.0); i++)
@@ -336,6 +425,8 @@ void tAgent::saveLogicTable(const char *filename)
         
         for (int repeat = 1; repeat < NUM_REPEATS; ++repeat)
         {
+            states &= ~(((uint64_t)1 << 30) - 1);
+            
             for(j = 0; j < 30; j++)
             {
                 if (j < 12)
@@ -345,7 +436,7 @@ void tAgent::saveLogicTable(const char *filename)
                         fprintf(f,"%i,",(i >> j) & 1);
                     }
                     
-                    states[j] = (i >> j) & 1;
+                    states |= (uint64_t)((i >> j) & 1) << j;
                 }
                 else if (j == 15)
                 {
@@ -354,20 +445,20 @@ void tAgent::saveLogicTable(const char *filename)
                         fprintf(f,"%i,",(i >> 12) & 1);
                     }
                     
-                    states[j] = (i >> 12) & 1;
-                }
-                else
-                {
-                    states[j] = 0;
+                    states |= (uint64_t)((i >> 12) & 1) << j;
                 }
             }
             
-            updateStates();
+#ifdef feedbackON
+            updateStates(rng);
+#else
+            states = logicBrain.update(states, rng);
+#endif
             
             vector<int> output;
             // order: 30 31
-            output.push_back(states[30]);
-            output.push_back(states[31]);
+            output.push_back((int)((states >> 30) & 1));
+            output.push_back((int)((states >> 31) & 1));
             
             if (outputCounts.count(output) > 0)
             {
@@ -403,13 +494,58 @@ void tAgent::saveLogicTable(const char *filename)
 void tAgent::saveGenome(const char *filename)
 {
     FILE *f=fopen(filename, "w");
+    // at most three digits and a tab per nucleotide, formatted by hand and written at once
+    vector<char> text;
+    text.reserve(genome.size() * 4 + 1);
     
 	for (int i = 0, end = (int)genome.size(); i < end; ++i)
     {
-		fprintf(f, "%i	", genome[i]);
+        int value = genome[i];
+        
+        if (value >= 100)
+        {
+            text.push_back((char)('0' + value / 100));
+        }
+        
+        if (value >= 10)
+        {
+            text.push_back((char)('0' + (value / 10) % 10));
+        }
+        
+        text.push_back((char)('0' + value % 10));
+        text.push_back('\t');
     }
     
-	fprintf(f, "\n");
+	text.push_back('\n');
+    fwrite(&text[0], 1, text.size(), f);
     
     fclose(f);
 }
+
+// save the genome in the binary format; the caller fills in the generation, fitness and run options
+// of header, the rest is set here. returns false if the file could not be written
+bool tAgent::saveGenomeBinary(const char *filename, tGenomeHeader &header)
+{
+    FILE *f=fopen(filename, "wb");
+    
+    if (f == NULL)
+    {
+        return false;
+    }
+    
+    memcpy(header.magic, genomeMagic, sizeof(header.magic));
+    header.version = genomeVersion;
+    header.length = (uint32_t)genome.size();
+    
+    vector<unsigned char> file(sizeof(header) + genome.size());
+    memcpy(&file[0], &header, sizeof(header));
+    
+    if (!genome.empty())
+    {
+        memcpy(&file[sizeof(header)], &genome[0], genome.size());
+    }
+    
+    bool ok = fwrite(&file[0], 1, file.size(), f) == file.size();
+    
+    return (fclose(f) == 0) && ok;
+}
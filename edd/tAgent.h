@@ -24,11 +24,38 @@
 
 #include "globalConst.h"
 #include "tHMM.h"
+#include "tRNG.h"
+#include "tBrain.h"
+#include <stdint.h>
 #include <vector>
+#include <memory>
+#include <atomic>
 
 using namespace std;
 
-static int masterID = 0;
+// agents are created on several threads at once with -islands
+static atomic<int> masterID(0);
+
+// layout of a binary genome file: this header, then length nucleotides
+// (all values in host byte order); text genome files are tab-separated numbers instead
+struct tGenomeHeader{
+	char magic[8];
+	uint32_t version;
+	uint32_t length;
+	// generation the genome was saved in, and its fitness then
+	uint32_t generation;
+	// the run options the genome was evolved with (genomeZoomingCamera | genomeRandomStart | genomeNoise)
+	uint32_t options;
+	int32_t gridSizeX, gridSizeY;
+	double noiseAmount;
+	double fitness;
+};
+
+#define     genomeMagic             "EDDGENO"
+#define     genomeVersion           1
+#define     genomeZoomingCamera     1
+#define     genomeRandomStart       2
+#define     genomeNoise             4
 
 class tDot{
 public:
@@ -38,12 +65,20 @@ public:
 
 class tAgent{
 public:
-	vector<tHMMU*> hmmus;
 	vector<unsigned char> genome;
+	// compiled phenotype of the genome; built on demand by setupPhenotype and dropped whenever the genome changes
+	shared_ptr<tBrain> brain;
+	// brain of the parent and the changes inherit made to its genome, until the own brain is built
+	shared_ptr<tBrain> parentBrain;
+	tGenomeEdits edits;
+	// scratch for the nucleotides a duplication copies
+	vector<unsigned char> duplicationBuffer;
 	
 	tAgent *ancestor;
 	unsigned int nrPointingAtMe;
-	unsigned char states[maxNodes], newStates[maxNodes];
+	// node i of the brain is bit i
+	uint64_t states;
+	tRNG rng;
 	double fitness, classificationFitness;
 	vector<double> fitnesses;
     
@@ -51,17 +86,20 @@ public:
     int truePositives[10], falsePositives[10];
     int trueNegatives[10], falseNegatives[10];
     float truePositiveRate[10], trueNegativeRate[10];
+    // digits classified correctly, by the number of digits guessed (each scores 1 / guessed)
+    int correctGuesses[11];
 
 	int ID, nrOfOffspring;
 	int born;
 	
 	tAgent();
 	~tAgent();
+	void recycle(void);
 	void setupRandomAgent(int nucleotides);
-	void loadAgent(char* filename);
+	bool loadAgent(const char* filename, tGenomeHeader *header = NULL);
 	void setupPhenotype(void);
 	void inherit(tAgent *from,double mutationRate,int theTime, bool evolveRetina);
-	void updateStates(void);
+	void updateStates(tRNG &rng);
 	void resetBrain(void);
 	void ampUpStartCodons(void);
 	void showBrain(void);
@@ -70,6 +108,7 @@ public:
 	void initialize(int x, int y, int d);
 	void saveLogicTable(const char *filename);
 	void saveGenome(const char *filename);
+	bool saveGenomeBinary(const char *filename, tGenomeHeader &header);
 };
 
 #endif
\ No newline at end of file
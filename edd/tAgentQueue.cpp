@@ -0,0 +1,60 @@
+/*
+ * tAgentQueue.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tAgentQueue.h"
+
+tAgentQueue::tAgentQueue(int capacity)
+{
+	// one slot stays empty to tell a full queue from an empty one
+	slots.resize(capacity + 1, NULL);
+	head = 0;
+	tail = 0;
+}
+
+bool tAgentQueue::push(tAgent *agent)
+{
+	size_t position = tail.load(memory_order_relaxed);
+	size_t next = (position + 1) % slots.size();
+
+	if (next == head.load(memory_order_acquire))
+	{
+		return false;
+	}
+
+	slots[position] = agent;
+	// publishes the agent together with everything written to it before
+	tail.store(next, memory_order_release);
+	return true;
+}
+
+tAgent *tAgentQueue::pop(void)
+{
+	size_t position = head.load(memory_order_relaxed);
+
+	if (position == tail.load(memory_order_acquire))
+	{
+		return NULL;
+	}
+
+	tAgent *agent = slots[position];
+	head.store((position + 1) % slots.size(), memory_order_release);
+	return agent;
+}
@@ -0,0 +1,48 @@
+/*
+ * tAgentQueue.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tAgentQueue_h_included_
+#define _tAgentQueue_h_included_
+
+#include <vector>
+#include <atomic>
+#include "tAgent.h"
+
+using namespace std;
+
+// hands agents from one thread to another without locks:
+// exactly one thread pushes and exactly one thread pops
+class tAgentQueue{
+public:
+	tAgentQueue(int capacity);
+
+	// returns false if the queue is full
+	bool push(tAgent *agent);
+	// returns NULL if the queue is empty
+	tAgent *pop(void);
+
+private:
+	vector<tAgent*> slots;
+	// the next slot to pop from and the next one to push to; each is written by one side only
+	atomic<size_t> head, tail;
+};
+
+#endif
@@ -0,0 +1,698 @@
+/*
+ * tBrain.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tBrain.h"
+#include <algorithm>
+#include <atomic>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+tBrain::tBrain()
+{
+	nrOfGates = 0;
+	allDeterministic = true;
+	phenotypeHash = 0;
+	observedNodes = ~(uint64_t)0 << (maxNodes - nrOfOutputNodes);
+}
+
+tBrain::~tBrain()
+{
+}
+
+// drop the gates, keeping the memory of the arrays for the next genome
+void tBrain::recycle(void)
+{
+	hmmus.clear();
+	clear();
+}
+
+void tBrain::clear(void)
+{
+	nrOfGates = 0;
+	nrIns.clear();
+	ins.clear();
+	nrOuts.clear();
+	inMasks.clear();
+	deterministic.clear();
+	lookupStart.clear();
+	tableStart.clear();
+	sumsStart.clear();
+	lookup.clear();
+	table.clear();
+	sums.clear();
+	allDeterministic = true;
+	slicedStart.clear();
+	slicedNodes.clear();
+	slicedPatterns.clear();
+	phenotype.clear();
+	phenotypeHash = 0;
+}
+
+// find the gates worth running: the observed nodes are live, and so are the inputs of every gate that can set a live node,
+// across any number of updates. the sensor nodes are overwritten before they are read, so setting them does not count.
+// a dead gate cannot change what the agent does; stochastic gates are kept all the same,
+// because each one draws from the random stream and dropping it would change the draws of all gates after it
+void tBrain::findLiveGates(void)
+{
+	const uint64_t sensorNodes = ((uint64_t)1 << nrOfSensorNodes) - 1;
+	int nrOfDecodedGates = (int)hmmus.size();
+	uint64_t live = observedNodes;
+	bool changed = true;
+
+	liveGates.clear();
+
+	while (changed)
+	{
+		changed = false;
+
+		for (int gate = 0; gate < nrOfDecodedGates; ++gate)
+		{
+			tHMMU *hmmu = &hmmus[gate];
+			uint64_t inMask = 0, outMask = 0;
+
+			for (int i = 0; i < hmmu->_yDim; ++i)
+			{
+				inMask |= (uint64_t)1 << hmmu->ins[i];
+			}
+
+			for (int i = 0; i < hmmu->_xDim; ++i)
+			{
+				outMask |= (uint64_t)1 << hmmu->outs[i];
+			}
+
+			if ((outMask & ~sensorNodes & live) != 0 && (inMask & ~live) != 0)
+			{
+				live |= inMask;
+				changed = true;
+			}
+		}
+	}
+
+	for (int gate = 0; gate < nrOfDecodedGates; ++gate)
+	{
+		tHMMU *hmmu = &hmmus[gate];
+		uint64_t outMask = 0;
+
+		for (int i = 0; i < hmmu->_xDim; ++i)
+		{
+			outMask |= (uint64_t)1 << hmmu->outs[i];
+		}
+
+		if ((outMask & ~sensorNodes & live) != 0 || !hmmu->deterministic)
+		{
+			liveGates.push_back(gate);
+		}
+	}
+}
+
+// copy the live gates into the flat arrays
+void tBrain::compile(void)
+{
+	clear();
+	findLiveGates();
+	nrOfGates = (int)liveGates.size();
+	nrIns.resize(nrOfGates);
+	ins.resize(nrOfGates * maxGateIO, 0);
+	nrOuts.resize(nrOfGates);
+	inMasks.resize(nrOfGates);
+	deterministic.resize(nrOfGates);
+	lookupStart.resize(nrOfGates);
+	tableStart.resize(nrOfGates, 0);
+	sumsStart.resize(nrOfGates, 0);
+	slicedStart.resize(nrOfGates + 1, 0);
+
+	for (int gate = 0; gate < nrOfGates; ++gate)
+	{
+		tHMMU *hmmu = &hmmus[liveGates[gate]];
+		uint64_t inMask = 0, outMask[maxGateIO];
+
+		for (int i = 0; i < hmmu->_yDim; ++i)
+		{
+			inMask |= (uint64_t)1 << hmmu->ins[i];
+		}
+
+		for (int i = 0; i < hmmu->_xDim; ++i)
+		{
+			outMask[i] = (uint64_t)1 << hmmu->outs[i];
+		}
+
+		int nrDistinctIns = 0;
+
+		for (int node = 0; node < maxNodes; ++node)
+		{
+			if ((inMask >> node) & 1)
+			{
+				ins[gate * maxGateIO + nrDistinctIns] = (unsigned char)node;
+				++nrDistinctIns;
+			}
+		}
+
+		nrIns[gate] = (unsigned char)nrDistinctIns;
+		nrOuts[gate] = (unsigned char)hmmu->_xDim;
+		inMasks[gate] = inMask;
+		deterministic[gate] = hmmu->deterministic;
+		lookupStart[gate] = (unsigned int)lookup.size();
+
+		if (!hmmu->deterministic)
+		{
+			for (int j = 0; j < (1 << hmmu->_xDim); ++j)
+			{
+				uint64_t mask = 0;
+
+				for (int i = 0; i < hmmu->_xDim; ++i)
+				{
+					if ((j >> i) & 1)
+					{
+						mask |= outMask[i];
+					}
+				}
+
+				lookup.push_back(mask);
+			}
+
+			tableStart[gate] = (unsigned int)table.size();
+			sumsStart[gate] = (unsigned int)sums.size();
+		}
+
+		// tHMMU numbers its rows by the inputs in genome order with the first input as the
+		// most significant bit (inputs may repeat); reorder them by the gathered bits instead
+		for (int pattern = 0; pattern < (1 << nrDistinctIns); ++pattern)
+		{
+			int row = 0;
+
+			for (int i = 0; i < hmmu->_yDim; ++i)
+			{
+				int k = 0;
+
+				while (ins[gate * maxGateIO + k] != hmmu->ins[i])
+				{
+					++k;
+				}
+
+				row = (row << 1) + ((pattern >> k) & 1);
+			}
+
+			if (hmmu->deterministic)
+			{
+				// the output pattern is the position of the row's single non-zero entry
+				int j = 0;
+				uint64_t mask = 0;
+
+				while (hmmu->hmm[row][j] == 0)
+				{
+					++j;
+				}
+
+				for (int i = 0; i < hmmu->_xDim; ++i)
+				{
+					if ((j >> i) & 1)
+					{
+						mask |= outMask[i];
+					}
+				}
+
+				lookup.push_back(mask);
+			}
+			else
+			{
+				table.insert(table.end(), hmmu->hmm[row], hmmu->hmm[row] + (1 << hmmu->_xDim));
+				sums.push_back(hmmu->sums[row]);
+			}
+		}
+
+		slicedStart[gate] = (unsigned int)slicedNodes.size();
+		allDeterministic = allDeterministic && hmmu->deterministic;
+
+		if (hmmu->deterministic)
+		{
+			uint64_t setNodes = 0;
+
+			for (int pattern = 0; pattern < (1 << nrDistinctIns); ++pattern)
+			{
+				setNodes |= lookup[lookupStart[gate] + pattern];
+			}
+
+			for (int node = 0; node < maxNodes; ++node)
+			{
+				if ((setNodes >> node) & 1)
+				{
+					uint16_t patterns = 0;
+
+					for (int pattern = 0; pattern < (1 << nrDistinctIns); ++pattern)
+					{
+						patterns |= (uint16_t)(((lookup[lookupStart[gate] + pattern] >> node) & 1) << pattern);
+					}
+
+					slicedNodes.push_back((unsigned char)node);
+					slicedPatterns.push_back(patterns);
+				}
+			}
+		}
+	}
+
+	slicedStart[nrOfGates] = (unsigned int)slicedNodes.size();
+
+	if (allDeterministic)
+	{
+		buildPhenotype();
+	}
+}
+
+// list the gates that set nodes once each, in a fixed order, and hash the list
+void tBrain::buildPhenotype(void)
+{
+	gateOrder.clear();
+
+	for (int gate = 0; gate < nrOfGates; ++gate)
+	{
+		uint64_t setNodes = 0;
+
+		for (int pattern = 0; pattern < (1 << nrIns[gate]); ++pattern)
+		{
+			setNodes |= lookup[lookupStart[gate] + pattern];
+		}
+
+		if (setNodes != 0)
+		{
+			gateOrder.push_back(gate);
+		}
+	}
+
+	// gates with the same input mask have tables of the same size
+	sort(gateOrder.begin(), gateOrder.end(), [&](int a, int b)
+	{
+		if (inMasks[a] != inMasks[b])
+		{
+			return inMasks[a] < inMasks[b];
+		}
+
+		return lexicographical_compare(&lookup[lookupStart[a]], &lookup[lookupStart[a]] + (1 << nrIns[a]),
+									   &lookup[lookupStart[b]], &lookup[lookupStart[b]] + (1 << nrIns[b]));
+	});
+
+	for (int i = 0; i < gateOrder.size(); ++i)
+	{
+		int gate = gateOrder[i];
+		const uint64_t *table = &lookup[lookupStart[gate]];
+
+		if (i > 0)
+		{
+			int previous = gateOrder[i - 1];
+
+			if (inMasks[previous] == inMasks[gate] && equal(table, table + (1 << nrIns[gate]), &lookup[lookupStart[previous]]))
+			{
+				continue;
+			}
+		}
+
+		phenotype.push_back(inMasks[gate]);
+		phenotype.insert(phenotype.end(), table, table + (1 << nrIns[gate]));
+	}
+
+	phenotypeHash = 14695981039346656037ULL;
+
+	for (int i = 0; i < phenotype.size(); ++i)
+	{
+		phenotypeHash = (phenotypeHash ^ phenotype[i]) * 0x9E3779B97F4A7C15ULL;
+		phenotypeHash ^= phenotypeHash >> 29;
+	}
+}
+
+// same results as tHMMU::update, gate by gate in genome order
+// deterministic gates look their output up directly and never touch rng
+uint64_t tBrain::update(uint64_t states, tRNG &rng)
+{
+	uint64_t newStates = 0;
+
+	for (int gate = 0; gate < nrOfGates; ++gate)
+	{
+#ifdef __BMI2__
+		unsigned int pattern = (unsigned int)_pext_u64(states, inMasks[gate]);
+#else
+		const unsigned char *gateIns = &ins[gate * maxGateIO];
+		unsigned int pattern = 0;
+
+		for (int i = 0, end = nrIns[gate]; i < end; ++i)
+		{
+			pattern |= (unsigned int)((states >> gateIns[i]) & 1) << i;
+		}
+#endif
+
+		if (deterministic[gate])
+		{
+			newStates |= lookup[lookupStart[gate] + pattern];
+		}
+		else
+		{
+			const unsigned char *row = &table[tableStart[gate] + (pattern << nrOuts[gate])];
+			int r = 1 + rng.nextInt(sums[sumsStart[gate] + pattern] - 1);
+			int j = 0;
+
+			while (r > row[j])
+			{
+				r -= row[j];
+				++j;
+			}
+
+			newStates |= lookup[lookupStart[gate] + j];
+		}
+	}
+
+	return newStates;
+}
+
+// update the brain on 64 inputs at once: states[node] holds the node's value for each of them in one bit,
+// and every gate becomes a few bitwise operations over these words
+// only for brains made of deterministic gates (allDeterministic)
+void tBrain::updateSliced(const uint64_t *states, uint64_t *newStates)
+{
+	for (int node = 0; node < maxNodes; ++node)
+	{
+		newStates[node] = 0;
+	}
+
+	for (int gate = 0; gate < nrOfGates; ++gate)
+	{
+		const unsigned char *gateIns = &ins[gate * maxGateIO];
+		uint64_t minterms[1 << maxGateIO];
+
+		// minterms[p]: the inputs whose gathered pattern is p
+		minterms[0] = ~(uint64_t)0;
+
+		for (int i = 0, end = nrIns[gate]; i < end; ++i)
+		{
+			uint64_t in = states[gateIns[i]];
+
+			for (int pattern = 0; pattern < (1 << i); ++pattern)
+			{
+				minterms[pattern | (1 << i)] = minterms[pattern] & in;
+				minterms[pattern] &= ~in;
+			}
+		}
+
+		for (unsigned int k = slicedStart[gate], end = slicedStart[gate + 1]; k < end; ++k)
+		{
+			unsigned int patterns = slicedPatterns[k];
+			uint64_t value = 0;
+
+			for (int pattern = 0; patterns != 0; ++pattern, patterns >>= 1)
+			{
+				value |= minterms[pattern] & ((uint64_t)0 - (patterns & 1));
+			}
+
+			newStates[slicedNodes[k]] |= value;
+		}
+	}
+}
+
+// decode the gate whose start codon is at the given position into gate, or return false if there is none
+bool tBrain::decodeGate(vector<unsigned char> &genome, int start, tHMMU &gate)
+{
+	if ((genome[start] == 42) && (genome[(start + 1) % genome.size()] == (255 - 42)))
+	{
+		gate.setupDeterministic(genome, start);
+		//gate.setup(genome, start);
+		return true;
+	}
+	/*
+	if ((genome[start] == 43) && (genome[(start + 1) % genome.size()] == (255 - 43)))
+	{
+		//gate.setup(genome, start);
+		gate.setupDeterministic(genome, start);
+		return true;
+	}
+	*/
+
+	return false;
+}
+
+// decode every gate of the genome and compile them
+void tBrain::decode(vector<unsigned char> &genome)
+{
+	tHMMU hmmu;
+
+	for (int i = 0; i < genome.size(); ++i)
+	{
+		if (decodeGate(genome, i, hmmu))
+		{
+			hmmus.push_back(hmmu);
+		}
+	}
+
+	compile();
+}
+
+// build the brain of an offspring from its parent's brain:
+// gates whose whole genome range was copied over untouched are taken from the parent,
+// and only the start codons around changed sites are decoded again
+void tBrain::decode(vector<unsigned char> &genome, tBrain *parent, tGenomeEdits &edits)
+{
+	int size = (int)genome.size();
+	vector<tHMMU> &kept = keptHmmus;
+	vector<int> &candidates = candidateStarts;
+
+	kept.clear();
+	candidates.clear();
+
+	for (int i = 0; i < parent->hmmus.size(); ++i)
+	{
+		tHMMU *gate = &parent->hmmus[i];
+		int start = -1;
+		bool untouched = false;
+
+		// find where the gate's start codon ended up in the offspring
+		for (int s = 0; s < edits.segments.size(); ++s)
+		{
+			tGenomeSegment &segment = edits.segments[s];
+
+			if (segment.parentStart != -1 && gate->start >= segment.parentStart && gate->start < segment.parentStart + segment.length)
+			{
+				start = segment.start + (gate->start - segment.parentStart);
+
+				// the range has to sit inside one copied segment, without wrapping around either genome
+				untouched = (gate->start + gate->length <= segment.parentStart + segment.length)
+							&& (gate->start + gate->length <= edits.parentSize)
+							&& (start + gate->length <= size);
+				break;
+			}
+		}
+
+		if (untouched)
+		{
+			vector<int>::iterator mutation = lower_bound(edits.pointMutations.begin(), edits.pointMutations.end(), gate->start);
+			untouched = (mutation == edits.pointMutations.end()) || (*mutation >= gate->start + gate->length);
+		}
+
+		if (untouched)
+		{
+			kept.push_back(*gate);
+			kept.back().start = start;
+		}
+		else if (start != -1)
+		{
+			candidates.push_back(start);
+		}
+	}
+
+	// start codons can appear or disappear wherever the nucleotides changed:
+	// around point mutations, inside duplicated stretches, across segment joins and across the end of the genome
+	for (int i = 0; i < edits.pointMutations.size(); ++i)
+	{
+		int mutation = edits.pointMutations[i];
+
+		for (int s = 0; s < edits.segments.size(); ++s)
+		{
+			tGenomeSegment &segment = edits.segments[s];
+
+			if (segment.parentStart != -1 && mutation >= segment.parentStart && mutation < segment.parentStart + segment.length)
+			{
+				int position = segment.start + (mutation - segment.parentStart);
+				candidates.push_back(position);
+				candidates.push_back((position + size - 1) % size);
+				break;
+			}
+		}
+	}
+
+	for (int s = 0; s < edits.segments.size(); ++s)
+	{
+		tGenomeSegment &segment = edits.segments[s];
+
+		if (segment.parentStart == -1)
+		{
+			for (int position = segment.start; position < segment.start + segment.length; ++position)
+			{
+				candidates.push_back(position);
+			}
+		}
+
+		candidates.push_back((segment.start + size - 1) % size);
+	}
+
+	candidates.push_back(size - 1);
+
+	sort(candidates.begin(), candidates.end());
+	candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+	// merge the kept gates and the newly decoded ones back into genome order
+	int k = 0;
+	tHMMU hmmu;
+
+	for (int i = 0; i < candidates.size(); ++i)
+	{
+		while (k < kept.size() && kept[k].start < candidates[i])
+		{
+			hmmus.push_back(kept[k++]);
+		}
+
+		if (decodeGate(genome, candidates[i], hmmu))
+		{
+			hmmus.push_back(hmmu);
+		}
+	}
+
+	while (k < kept.size())
+	{
+		hmmus.push_back(kept[k++]);
+	}
+
+	compile();
+}
+
+void tGenomeEdits::reset(int parentSize)
+{
+	tGenomeSegment all = { 0, 0, parentSize };
+
+	this->parentSize = parentSize;
+	pointMutations.clear();
+	segments.clear();
+	segments.push_back(all);
+}
+
+// length new nucleotides were inserted in front of the given offspring position
+void tGenomeEdits::insert(int position, int length)
+{
+	for (int s = 0; s < segments.size(); ++s)
+	{
+		tGenomeSegment &segment = segments[s];
+
+		if (position >= segment.start && position < segment.start + segment.length)
+		{
+			// split the segment at the insertion point
+			if (position > segment.start)
+			{
+				tGenomeSegment tail = segment;
+				int headLength = position - segment.start;
+
+				tail.start += headLength;
+				tail.length -= headLength;
+				if (tail.parentStart != -1)
+				{
+					tail.parentStart += headLength;
+				}
+				segment.length = headLength;
+				segments.insert(segments.begin() + s + 1, tail);
+				++s;
+			}
+
+			tGenomeSegment inserted = { position, -1, length };
+			segments.insert(segments.begin() + s, inserted);
+
+			for (int t = s + 1; t < segments.size(); ++t)
+			{
+				segments[t].start += length;
+			}
+
+			return;
+		}
+	}
+}
+
+// length nucleotides were removed from the given offspring position on
+void tGenomeEdits::erase(int position, int length)
+{
+	vector<tGenomeSegment> remaining;
+	int end = position + length;
+
+	for (int s = 0; s < segments.size(); ++s)
+	{
+		tGenomeSegment segment = segments[s];
+		int segmentEnd = segment.start + segment.length;
+
+		// part in front of the removed stretch
+		if (segment.start < position)
+		{
+			tGenomeSegment head = segment;
+			head.length = min(segmentEnd, position) - segment.start;
+			remaining.push_back(head);
+		}
+
+		// part behind the removed stretch, moved forward
+		if (segmentEnd > end)
+		{
+			tGenomeSegment tail = segment;
+			int skipped = max(end, segment.start) - segment.start;
+
+			tail.start = max(end, segment.start) - length;
+			tail.length = segment.length - skipped;
+			if (tail.parentStart != -1)
+			{
+				tail.parentStart += skipped;
+			}
+			remaining.push_back(tail);
+		}
+	}
+
+	segments = remaining;
+}
+
+tBrainPool brainPool;
+
+tBrainPool::tBrainPool()
+{
+	next = 0;
+}
+
+shared_ptr<tBrain> tBrainPool::get(void)
+{
+	unique_lock<mutex> guard(lock);
+
+	// only agents copy brains from each other, so a brain the pool holds alone stays free while the pool is locked
+	for (size_t i = 0; i < brains.size(); ++i, ++next)
+	{
+		if (next >= brains.size())
+		{
+			next = 0;
+		}
+
+		if (brains[next].use_count() == 1)
+		{
+			// see everything the last agent did with the brain before letting go of it
+			atomic_thread_fence(memory_order_acquire);
+			brains[next]->recycle();
+			return brains[next++];
+		}
+	}
+
+	brains.push_back(make_shared<tBrain>());
+	return brains.back();
+}
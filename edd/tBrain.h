@@ -0,0 +1,141 @@
+/*
+ * tBrain.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tBrain_h_included_
+#define _tBrain_h_included_
+
+#include "globalConst.h"
+#include "tHMM.h"
+#include "tRNG.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+#if maxNodes > 64
+#error "the brain state is packed into one 64-bit word, so maxNodes cannot exceed 64"
+#endif
+
+// a stretch of an offspring genome that was copied from the parent in one piece
+// parentStart is -1 for nucleotides inserted by a duplication
+struct tGenomeSegment{
+	int start, parentStart, length;
+};
+
+// records how tAgent::inherit turned the parent genome into the offspring genome,
+// so the offspring's brain can be rebuilt from the parent's by decoding only the affected gates
+class tGenomeEdits{
+public:
+	int parentSize;
+	// sites whose value was changed by a point mutation, in parent coordinates and ascending
+	vector<int> pointMutations;
+	// the offspring genome in order
+	vector<tGenomeSegment> segments;
+
+	void reset(int parentSize);
+	void insert(int position, int length);
+	void erase(int position, int length);
+};
+
+// the gates of a Markov network compiled into one flat program:
+// all gates are stored side by side in a few contiguous arrays,
+// so updating the brain is a single linear walk through memory.
+// the brain state is packed into one word with bit i holding node i.
+// a compiled brain depends on nothing but the genome, so agents with the same genome share one
+class tBrain{
+public:
+	// the decoded gates in genome order
+	vector<tHMMU> hmmus;
+	// scratch for the incremental decode
+	vector<tHMMU> keptHmmus;
+	vector<int> candidateStarts;
+
+	// the nodes read after an update: the output nodes, unless a brain is built for some other use
+	uint64_t observedNodes;
+	// the gates that can affect an observed node, by index into hmmus; the program is made of these only
+	vector<int> liveGates;
+	int nrOfGates;
+	// distinct input nodes of each gate in ascending order, maxGateIO slots per gate
+	vector<unsigned char> nrIns, ins;
+	vector<unsigned char> nrOuts;
+	// the same input nodes as a bit mask, for gathering them with PEXT
+	vector<uint64_t> inMasks;
+	vector<unsigned char> deterministic;
+	// tables are indexed by the gathered input bits, i.e. the gate's input nodes in ascending order
+	// deterministic gates: lookup holds the node mask to set for every input pattern
+	// stochastic gates: lookup holds the node mask for every output pattern,
+	// table and sums hold the probability rows back to back
+	vector<unsigned int> lookupStart, tableStart, sumsStart;
+	vector<uint64_t> lookup;
+	vector<unsigned char> table;
+	vector<unsigned int> sums;
+	// bit-sliced form of the deterministic gates, for updating the brain on 64 inputs at once:
+	// every node a gate can set, with the input patterns (bit p for gathered pattern p) that set it
+	bool allDeterministic;
+	vector<unsigned int> slicedStart;
+	vector<unsigned char> slicedNodes;
+	vector<uint16_t> slicedPatterns;
+	// canonical form of a brain of deterministic gates, for telling whether two brains behave the same:
+	// the outputs of all gates are or'ed together, so the order of the gates, duplicate gates and gates
+	// that never set a node do not matter. it lists the other gates sorted by their input mask followed by
+	// their lookup table (1 << inputs entries), and phenotypeHash is a hash of it.
+	// empty for brains with stochastic gates
+	vector<uint64_t> phenotype;
+	uint64_t phenotypeHash;
+	// scratch for sorting the gates
+	vector<int> gateOrder;
+
+	tBrain();
+	~tBrain();
+	void clear(void);
+	void recycle(void);
+	bool decodeGate(vector<unsigned char> &genome, int start, tHMMU &gate);
+	void decode(vector<unsigned char> &genome);
+	void decode(vector<unsigned char> &genome, tBrain *parent, tGenomeEdits &edits);
+	void findLiveGates(void);
+	void compile(void);
+	void buildPhenotype(void);
+	uint64_t update(uint64_t states, tRNG &rng);
+	void updateSliced(const uint64_t *states, uint64_t *newStates);
+
+private:
+	tBrain(const tBrain &);
+	tBrain &operator=(const tBrain &);
+};
+
+// hands out brains for decoding, reusing the ones no agent holds anymore
+// together with their arrays, so a new genome does not need a freshly allocated brain;
+// a brain is free again when the pool holds the only reference to it
+class tBrainPool{
+public:
+	tBrainPool();
+	shared_ptr<tBrain> get(void);
+
+private:
+	mutex lock;
+	vector< shared_ptr<tBrain> > brains;
+	size_t next;
+};
+
+extern tBrainPool brainPool;
+
+#endif
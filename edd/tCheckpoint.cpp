@@ -0,0 +1,155 @@
+/*
+ * tCheckpoint.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tCheckpoint.h"
+#include <stdio.h>
+
+tCheckpoint::tCheckpoint()
+{
+	position = 0;
+	writeFailed = false;
+}
+
+tCheckpoint::~tCheckpoint()
+{
+	wait();
+}
+
+void tCheckpoint::clear(void)
+{
+	uint32_t version = checkpointVersion;
+
+	buffer.assign(checkpointMagic, checkpointMagic + 8);
+	put(version);
+}
+
+void tCheckpoint::putBytes(const void *bytes, size_t size)
+{
+	buffer.insert(buffer.end(), (const unsigned char *)bytes, (const unsigned char *)bytes + size);
+}
+
+void tCheckpoint::putString(const string &value)
+{
+	uint32_t length = (uint32_t)value.size();
+
+	put(length);
+	putBytes(value.data(), length);
+}
+
+void tCheckpoint::writeAsync(const string &filename)
+{
+	// only one write at a time; the previous one is normally long done
+	wait();
+	writing.swap(buffer);
+	writer = thread(&tCheckpoint::writeFile, this, filename);
+}
+
+bool tCheckpoint::wait(void)
+{
+	if (writer.joinable())
+	{
+		writer.join();
+	}
+
+	return !writeFailed;
+}
+
+void tCheckpoint::writeFile(string filename)
+{
+	string temporaryFilename = filename + ".tmp";
+	FILE *f = fopen(temporaryFilename.c_str(), "wb");
+	bool ok = (f != NULL);
+
+	ok = ok && fwrite(&writing[0], 1, writing.size(), f) == writing.size();
+	ok = (f != NULL) && (fclose(f) == 0) && ok;
+	ok = ok && rename(temporaryFilename.c_str(), filename.c_str()) == 0;
+
+	if (!ok)
+	{
+		fprintf(stderr, "could not write checkpoint %s\n", filename.c_str());
+	}
+
+	writeFailed = !ok;
+}
+
+bool tCheckpoint::read(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	char magic[8];
+	uint32_t version = 0;
+
+	if (f == NULL)
+	{
+		return false;
+	}
+
+	buffer.clear();
+	position = 0;
+
+	unsigned char block[1 << 16];
+	size_t count;
+
+	while ((count = fread(block, 1, sizeof(block), f)) > 0)
+	{
+		buffer.insert(buffer.end(), block, block + count);
+	}
+
+	fclose(f);
+
+	if (!getBytes(magic, sizeof(magic)) || memcmp(magic, checkpointMagic, sizeof(magic)) != 0)
+	{
+		return false;
+	}
+
+	if (!get(version) || version != checkpointVersion)
+	{
+		fprintf(stderr, "unsupported checkpoint version in %s\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool tCheckpoint::getBytes(void *bytes, size_t size)
+{
+	if (buffer.size() - position < size)
+	{
+		return false;
+	}
+
+	memcpy(bytes, &buffer[position], size);
+	position += size;
+	return true;
+}
+
+bool tCheckpoint::getString(string &value)
+{
+	uint32_t length = 0;
+
+	if (!get(length) || buffer.size() - position < length)
+	{
+		return false;
+	}
+
+	value.assign((const char *)&buffer[position], length);
+	position += length;
+	return true;
+}
@@ -0,0 +1,79 @@
+/*
+ * tCheckpoint.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tCheckpoint_h_included_
+#define _tCheckpoint_h_included_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+using namespace std;
+
+#define     checkpointMagic     "EDDCKPT"
+// version 2 added -gb and -nocache to the stored options
+#define     checkpointVersion   2
+
+// a snapshot of an evolutionary run as one flat block of bytes (host byte order):
+// the magic and version, then whatever the run put into it, read back in the same order.
+// writing hands the block to a background thread, so the run can go on while it is saved
+class tCheckpoint{
+public:
+	tCheckpoint();
+	~tCheckpoint();
+
+	// start a new snapshot
+	void clear(void);
+	template <class T> void put(const T &value)
+	{
+		putBytes(&value, sizeof(T));
+	}
+	void putBytes(const void *bytes, size_t size);
+	void putString(const string &value);
+	// write the snapshot to the file in the background; the file is replaced only once
+	// the snapshot is completely written, so a run killed meanwhile leaves the previous one intact
+	void writeAsync(const string &filename);
+	// wait until the last write finished; returns false if it failed
+	bool wait(void);
+
+	// load a snapshot to be read from the start; returns false if the file is missing or not a checkpoint
+	bool read(const char *filename);
+	template <class T> bool get(T &value)
+	{
+		return getBytes(&value, sizeof(T));
+	}
+	bool getBytes(void *bytes, size_t size);
+	bool getString(string &value);
+
+private:
+	vector<unsigned char> buffer, writing;
+	size_t position;
+	thread writer;
+	bool writeFailed;
+
+	tCheckpoint(const tCheckpoint &);
+	tCheckpoint &operator=(const tCheckpoint &);
+	void writeFile(string filename);
+};
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * tDataset.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tDataset.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string>
+
+tDataset::tDataset()
+{
+    mapping = NULL;
+    mappingSize = 0;
+    setup(0, 0);
+}
+
+tDataset::~tDataset()
+{
+    unmap();
+}
+
+void tDataset::unmap(void)
+{
+    if (mapping != NULL)
+    {
+        munmap(mapping, mappingSize);
+        mapping = NULL;
+        mappingSize = 0;
+    }
+}
+
+// start an empty dataset of images with the given size
+void tDataset::setup(int sizeX, int sizeY)
+{
+    this->sizeX = sizeX;
+    this->sizeY = sizeY;
+    wordsPerImage = (sizeX * sizeY + 63) / 64;
+    nrOfImages = 0;
+    unmap();
+    bits.clear();
+    labelBytes.clear();
+    data = NULL;
+    labels = NULL;
+}
+
+// pack an image given as image[x][y] = 0 or 1
+void tDataset::addImage(vector< vector<int> > &image, int label)
+{
+    bits.resize(bits.size() + wordsPerImage, 0);
+    labelBytes.push_back((unsigned char)label);
+    uint64_t *words = &bits[(size_t)nrOfImages * wordsPerImage];
+    
+    for (int x = 0; x < sizeX && x < image.size(); ++x)
+    {
+        for (int y = 0; y < sizeY && y < image[x].size(); ++y)
+        {
+            if (image[x][y] == 1)
+            {
+                int bit = x * sizeY + y;
+                words[bit >> 6] |= (uint64_t)1 << (bit & 63);
+            }
+        }
+    }
+    
+    ++nrOfImages;
+    data = &bits[0];
+    labels = &labelBytes[0];
+}
+
+// load the digits from the given file: a pre-compiled binary dataset, either the file itself
+// or the file name with ".bin" appended, is mapped into memory, and only without one
+// the text format is parsed; returns false if no images could be read
+bool tDataset::load(const char *filename)
+{
+    string binaryFilename = string(filename) + ".bin";
+    
+    if (loadBinary(filename) || loadBinary(binaryFilename.c_str()))
+    {
+        return true;
+    }
+    
+    return loadText(filename) && nrOfImages > 0;
+}
+
+// read the next image of the text format: a "label-number" line, followed by one line
+// of space separated 0s and 1s per row and an empty line; returns false at the end of the file
+bool tDataset::readTextImage(ifstream &symbolFile, vector< vector<int> > &symbol, int &label)
+{
+    string line;
+    
+    symbol.clear();
+    
+    while ( getline (symbolFile, line) )
+    {
+        if (line.find("-") != string::npos)
+        {
+            label = atoi(line.substr(0, line.find("-")).c_str());
+            symbol.clear();
+        }
+        
+        else if (line.find("0") != string::npos || line.find("1") != string::npos)
+        {
+            symbol.resize(symbol.size() + 1);
+            
+            for (int i = 0; i < line.length(); ++i)
+            {
+                if (line[i] == '0' || line[i] == '1')
+                {
+                    symbol.back().push_back(line[i] - '0');
+                }
+            }
+        }
+        
+        else if (!symbol.empty())
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// parse the text format into memory
+bool tDataset::loadText(const char *filename)
+{
+    ifstream symbolFile (filename);
+    vector< vector<int> > symbol;
+    int label = 0;
+    
+    if (!symbolFile.is_open())
+    {
+        return false;
+    }
+    
+    setup(0, 0);
+    
+    while (readTextImage(symbolFile, symbol, label))
+    {
+        // the first image decides the size of all of them
+        if (nrOfImages == 0)
+        {
+            setup((int)symbol.size(), (int)symbol[0].size());
+        }
+        
+        addImage(symbol, label);
+    }
+    
+    bits.shrink_to_fit();
+    labelBytes.shrink_to_fit();
+    data = bits.empty() ? NULL : &bits[0];
+    labels = labelBytes.empty() ? NULL : &labelBytes[0];
+    
+    return true;
+}
+
+// map a pre-compiled binary dataset straight into memory;
+// returns false if the file does not exist or is not a binary dataset
+bool tDataset::loadBinary(const char *filename)
+{
+    int file = open(filename, O_RDONLY);
+    
+    if (file < 0)
+    {
+        return false;
+    }
+    
+    struct stat status;
+    tDatasetHeader header;
+    
+    if (fstat(file, &status) != 0 || read(file, &header, sizeof(header)) != sizeof(header)
+        || memcmp(header.magic, datasetMagic, sizeof(header.magic)) != 0)
+    {
+        close(file);
+        return false;
+    }
+    
+    if (header.version != datasetVersion
+        || header.wordsPerImage != (header.sizeX * header.sizeY + 63) / 64
+        || (uint64_t)status.st_size < header.bitsOffset + (uint64_t)header.nrOfImages * header.wordsPerImage * sizeof(uint64_t)
+        || (uint64_t)status.st_size < header.labelsOffset + header.nrOfImages)
+    {
+        fprintf(stderr, "unsupported or truncated dataset file: %s\n", filename);
+        close(file);
+        return false;
+    }
+    
+    setup(header.sizeX, header.sizeY);
+    
+    mappingSize = (size_t)status.st_size;
+    mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    
+    if (mapping == MAP_FAILED)
+    {
+        mapping = NULL;
+        mappingSize = 0;
+        return false;
+    }
+    
+    nrOfImages = header.nrOfImages;
+    labels = (const unsigned char *)mapping + header.labelsOffset;
+    data = (const uint64_t *)((const char *)mapping + header.bitsOffset);
+    
+    return true;
+}
+
+// convert a text digit file to the pre-compiled binary format one image at a time,
+// so files of any size can be converted without holding them in memory;
+// returns the number of images written, or -1 if a file could not be opened or written
+int tDataset::convertText(const char *textFilename, const char *binaryFilename)
+{
+    ifstream symbolFile (textFilename);
+    
+    if (!symbolFile.is_open())
+    {
+        return -1;
+    }
+    
+    FILE *f = fopen(binaryFilename, "wb");
+    
+    if (f == NULL)
+    {
+        return -1;
+    }
+    
+    tDataset packer;
+    tDatasetHeader header;
+    vector< vector<int> > symbol;
+    vector<unsigned char> imageLabels;
+    int label = 0;
+    bool ok = true;
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, datasetMagic, sizeof(header.magic));
+    header.version = datasetVersion;
+    header.bitsOffset = sizeof(header);
+    
+    // the header is written again once the number of images is known
+    ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+    
+    while (ok && readTextImage(symbolFile, symbol, label))
+    {
+        if (imageLabels.empty())
+        {
+            packer.setup((int)symbol.size(), (int)symbol[0].size());
+        }
+        
+        // pack the image on its own and pass it straight on to the file
+        packer.nrOfImages = 0;
+        packer.bits.clear();
+        packer.labelBytes.clear();
+        packer.addImage(symbol, label);
+        imageLabels.push_back((unsigned char)label);
+        ok = fwrite(packer.data, sizeof(uint64_t), packer.wordsPerImage, f) == (size_t)packer.wordsPerImage;
+    }
+    
+    header.nrOfImages = (uint32_t)imageLabels.size();
+    header.sizeX = packer.sizeX;
+    header.sizeY = packer.sizeY;
+    header.wordsPerImage = packer.wordsPerImage;
+    header.labelsOffset = header.bitsOffset + (uint64_t)header.nrOfImages * header.wordsPerImage * sizeof(uint64_t);
+    
+    ok = ok && (imageLabels.empty() || fwrite(&imageLabels[0], 1, imageLabels.size(), f) == imageLabels.size());
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    
+    return ok ? (int)header.nrOfImages : -1;
+}
+
+// whether any pixel in the bit range [fromBit, toBit) of the image is set
+bool tDataset::anyPixel(int index, int fromBit, int toBit)
+{
+    const uint64_t *words = image(index);
+    
+    while (fromBit < toBit)
+    {
+        int bit = fromBit & 63;
+        int count = (toBit - fromBit < 64 - bit) ? (toBit - fromBit) : (64 - bit);
+        uint64_t mask = (count == 64) ? ~(uint64_t)0 : ((((uint64_t)1 << count) - 1) << bit);
+        
+        if (words[fromBit >> 6] & mask)
+        {
+            return true;
+        }
+        
+        fromBit += count;
+    }
+    
+    return false;
+}
@@ -0,0 +1,101 @@
+/*
+ * tDataset.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tDataset_h_included_
+#define _tDataset_h_included_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <fstream>
+
+using namespace std;
+
+// layout of a pre-compiled binary dataset file:
+// this header, the packed images starting at bitsOffset, then one label byte per image at labelsOffset
+// (all values in host byte order, bitsOffset is a multiple of 8)
+struct tDatasetHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t nrOfImages;
+    uint32_t sizeX, sizeY;
+    uint32_t wordsPerImage;
+    uint32_t reserved;
+    uint64_t bitsOffset;
+    uint64_t labelsOffset;
+};
+
+#define     datasetMagic        "EDDDATA"
+// version 2 moved labelsOffset behind bitsOffset and widened it to 64 bits
+#define     datasetVersion      2
+
+// bit-packed store of black and white images
+// every image is one contiguous row-major bitset: pixel (x, y) is bit x * sizeY + y,
+// and consecutive images start wordsPerImage 64-bit words apart
+class tDataset{
+public:
+    int nrOfImages;
+    // pixels per image along x (rows of the text file) and y (columns)
+    int sizeX, sizeY;
+    int wordsPerImage;
+    
+    // the packed images and their labels: either the vectors below
+    // or, for binary files, the memory-mapped file itself, which the operating system
+    // pages in and out as needed, so the images never have to fit into memory at once
+    const uint64_t *data;
+    const unsigned char *labels;
+    vector<uint64_t> bits;
+    vector<unsigned char> labelBytes;
+    
+    tDataset();
+    ~tDataset();
+    void setup(int sizeX, int sizeY);
+    void addImage(vector< vector<int> > &image, int label);
+    bool load(const char *filename);
+    bool loadText(const char *filename);
+    bool loadBinary(const char *filename);
+    static int convertText(const char *textFilename, const char *binaryFilename);
+    
+    inline const uint64_t *image(int index)
+    {
+        return data + (size_t)index * wordsPerImage;
+    }
+    
+    // (x, y) must lie inside the image
+    inline bool pixel(int index, int x, int y)
+    {
+        int bit = x * sizeY + y;
+        return (image(index)[bit >> 6] >> (bit & 63)) & 1;
+    }
+    
+    bool anyPixel(int index, int fromBit, int toBit);
+    
+private:
+    void *mapping;
+    size_t mappingSize;
+    
+    void unmap(void);
+    static bool readTextImage(ifstream &symbolFile, vector< vector<int> > &symbol, int &label);
+    tDataset(const tDataset &);
+    tDataset &operator=(const tDataset &);
+};
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * tFitnessCache.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tFitnessCache.h"
+#include <algorithm>
+
+tFitnessCache::tFitnessCache()
+{
+	nrOfEntries = 0;
+}
+
+bool tFitnessCache::find(tBrain *brain, double &fitness, double &classificationFitness)
+{
+	vector< pair<uint64_t, int> >::iterator it = lower_bound(index.begin(), index.end(), make_pair(brain->phenotypeHash, 0));
+
+	// a hash says nothing for certain, only the phenotype itself does
+	for ( ; it != index.end() && it->first == brain->phenotypeHash; ++it)
+	{
+		tEntry &entry = entries[it->second];
+
+		if (entry.phenotype == brain->phenotype)
+		{
+			fitness = entry.fitness;
+			classificationFitness = entry.classificationFitness;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void tFitnessCache::store(vector<tAgent*> &agents)
+{
+	nrOfEntries = 0;
+	index.clear();
+
+	if (entries.size() < agents.size())
+	{
+		entries.resize(agents.size());
+	}
+
+	for (int i = 0; i < (int)agents.size(); ++i)
+	{
+		tAgent *agent = agents[i];
+
+		if (!agent->brain || !agent->brain->allDeterministic)
+		{
+			continue;
+		}
+
+		tEntry &entry = entries[nrOfEntries];
+		entry.phenotype.assign(agent->brain->phenotype.begin(), agent->brain->phenotype.end());
+		entry.fitness = agent->fitness;
+		entry.classificationFitness = agent->classificationFitness;
+		index.push_back(make_pair(agent->brain->phenotypeHash, nrOfEntries));
+		++nrOfEntries;
+	}
+
+	sort(index.begin(), index.end());
+}
@@ -0,0 +1,59 @@
+/*
+ * tFitnessCache.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tFitnessCache_h_included_
+#define _tFitnessCache_h_included_
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include "tAgent.h"
+
+using namespace std;
+
+// the fitness of the brains of the last generation. when the brain is made of deterministic gates,
+// the camera starts in the same place and the agents are tested on the same digits every generation,
+// the fitness depends on nothing but what the brain does, so an agent whose brain behaves like one
+// already tested (an unmutated copy, or an offspring whose mutations did not change any gate that matters)
+// does not need to be tested again. brains are compared by their canonical phenotype (tBrain::phenotype)
+class tFitnessCache{
+public:
+	tFitnessCache();
+
+	// looks the brain up; any number of threads can look up at the same time, as long as none stores
+	bool find(tBrain *brain, double &fitness, double &classificationFitness);
+	// replaces the contents by the agents just tested; only agents with a brain of deterministic gates are kept
+	void store(vector<tAgent*> &agents);
+
+private:
+	struct tEntry{
+		vector<uint64_t> phenotype;
+		double fitness, classificationFitness;
+	};
+
+	// only the first nrOfEntries entries are in use; the rest keep their phenotype vectors (and the memory they hold) to be refilled in later generations
+	vector<tEntry> entries;
+	int nrOfEntries;
+	// (hash, entry) sorted by hash
+	vector< pair<uint64_t, int> > index;
+};
+
+#endif
@@ -33,21 +33,10 @@
 // simulation-specific constants
 #define totalStepsInSimulation      40
 #define MAX_CAM_SIZE                3
+// the sensor bits a 3x3 camera reads, i.e. the number of distinct views of a digit is 1 << nrOfViewBits
+#define nrOfViewBits                ((MAX_CAM_SIZE * MAX_CAM_SIZE) + 4)
 
-// each sensor's (x, y) offset from the center of the camera
-vector< vector<int> > sensorOffsetMap;
-
-map< string, vector< vector<int> > > symbols;
-vector<string> symbol_keys;
-vector<int> symbol_labels;
-
-// grid that the digits are placed in
-// first index is for the digit
-// following two indeces are the X and Y positions in that digit's grid
-// (center - gridSizeX / 2, center - gridSizeY / 2) is the bottom-left corner of the digit
-vector< vector< vector<int> > > digitGrid;
-
-tGame::tGame(int gridSizeX, int gridSizeY)
+tGame::tGame(const char *datasetFileName, int gridSizeX, int gridSizeY)
 {
     // pre-compute the sensor offsets
     // to maintain the same order of inputs, start counting sensors from the inside.
@@ -96,71 +85,33 @@ tGame::tGame(int gridSizeX, int gridSizeY)
         sensorOffsetMap.push_back(offsets);
     }
     
-    ifstream symbolFile ("mnist.train.discrete.28x28-only100");
-    string line;
-    string key = "";
-    vector< vector<int> > symbol;
-    int symbolRow = 0;
-
-    while ( getline (symbolFile, line) )
-      {
-	if (line.find("-") != string::npos)
-	  {
-	    key = line;
-	    symbol.clear();
-	    symbolRow = 0;
-	  }
-	
-	else if (line.find("0") != string::npos || line.find("1") != string::npos)
-	  {
-	    symbol.resize(symbol.size() + 1);
-	    
-	    for (int i = 0; i < line.length(); ++i)
-	      {
-		if (line.substr(i, 1) != " ")
-		  {
-		    symbol[symbolRow].push_back(atoi(line.substr(i, 1).c_str()));
-		  }
-	      }
-	    
-	    ++symbolRow;
-	  }
-
-	else
-	  {
-	    symbols[key] = symbol;
-	    symbol_keys.push_back(key);
-	    symbol_labels.push_back(atoi(key.substr(0, key.find("-")).c_str()));
-	  }
-      }
-
-    symbolFile.close();
+    // load the digits for the edd agent to view
+    dataset.load(datasetFileName);
     
-    // place the digits in the digit grid for the edd agent to view
-    int num_symbol_keys = (int)symbol_keys.size();
-    digitGrid.resize(num_symbol_keys);
+    // name the digits like the text format does: label-number, counting the images of every label from 1
+    int labelCounts[256] = { 0 };
     
-    for (int digit = 0; digit < num_symbol_keys; ++digit)
+    for (int digit = 0; digit < dataset.nrOfImages; ++digit)
     {
-        digitGrid[digit].resize(gridSizeX);
-        for (int x = 0; x < gridSizeX; ++x)
-        {
-            digitGrid[digit][x].resize(gridSizeY);
-        }
+        stringstream key;
+        key << (int)dataset.labels[digit] << "-" << ++labelCounts[dataset.labels[digit]];
+        symbol_keys.push_back(key.str());
     }
     
-    // if the digits are being randomly placed, place all 10 digits (0-9)
-    // in random spots on the grid at the beginning of every simulation
-    // otherwise, place all 10 digits (0-9) centered in the grid
-    for (int digit = 0; digit < num_symbol_keys; ++digit)
-    {
-        int digitCenterX = (int)(gridSizeX / 2.0), digitCenterY = (int)(gridSizeY / 2.0);
-        
-        placeDigit(digitGrid, digit, digitCenterX, digitCenterY);
-    }
+    // place all digits centered in the grid
+    int digitCenterX = (int)(gridSizeX / 2.0), digitCenterY = (int)(gridSizeY / 2.0);
+    digitOffsetX = digitCenterX - dataset.sizeX / 2;
+    digitOffsetY = digitCenterY - dataset.sizeY / 2;
+    
+    // no precomputed sensor views until buildSensorViews is called
+    sensorViewOriginX = sensorViewOriginY = 0;
+    sensorViewsX = sensorViewsY = 0;
+    sensorViewsClamped = false;
+    
+    setupThreads(1);
     
     // visualize the digits
-    /*for (int digit = 0; digit < num_symbol_keys; ++digit)
+    /*for (int digit = 0; digit < dataset.nrOfImages; ++digit)
      {
      cout << symbol_keys[digit] << endl;
      
@@ -168,7 +119,7 @@ tGame::tGame(int gridSizeX, int gridSizeY)
      {
 	    for (int y = 0; y < gridSizeY; ++y)
      {
-     cout << digitGrid[digit][x][y] << " ";
+     cout << digitPixel(digit, x, y) << " ";
      }
 	    cout << endl;
      }
@@ -179,20 +130,233 @@ tGame::tGame(int gridSizeX, int gridSizeY)
 
 tGame::~tGame() { }
 
+// one set of scratch buffers per evaluation thread
+void tGame::setupThreads(int nrOfThreads)
+{
+    scratch.resize(nrOfThreads);
+    
+    for (int thread = 0; thread < nrOfThreads; ++thread)
+    {
+        scratch[thread].groupOfView.assign(1 << nrOfViewBits, -1);
+    }
+}
+
+// precompute what the 3x3 camera sees of every digit, so a sensor read is a single table lookup.
+// with allCameraPositions, the table covers every camera position from 2 beyond the top/left edge of the grid
+// to 2 beyond the bottom/right edge: further out, the camera sees the same as on that border.
+// otherwise, for a camera that stays in the center of the grid, only the center is stored.
+// a table for all camera positions takes 2 * (gridSizeX + 4) * (gridSizeY + 4) bytes per digit, all of it in memory;
+// when that is more than maxBytes, no table is built and every sensor read looks at the digit itself (returns false)
+bool tGame::buildSensorViews(int gridSizeX, int gridSizeY, bool allCameraPositions, size_t maxBytes, tThreadPool *threadPool)
+{
+    sensorViews.clear();
+    sensorViewsX = sensorViewsY = 0;
+    sensorViewsClamped = false;
+    digitGroups.views.clear();
+    digitGroups.labelCounts.clear();
+    
+    if (allCameraPositions && (size_t)dataset.nrOfImages * (gridSizeX + 4) * (gridSizeY + 4) * sizeof(uint16_t) > maxBytes)
+    {
+        return false;
+    }
+    
+    if (allCameraPositions)
+    {
+        sensorViewOriginX = -2;
+        sensorViewOriginY = -2;
+        sensorViewsX = gridSizeX + 4;
+        sensorViewsY = gridSizeY + 4;
+        sensorViewsClamped = true;
+    }
+    else
+    {
+        sensorViewOriginX = (int)(gridSizeX / 2.0);
+        sensorViewOriginY = (int)(gridSizeY / 2.0);
+        sensorViewsX = 1;
+        sensorViewsY = 1;
+        sensorViewsClamped = false;
+    }
+    
+    vector<uint16_t> views((size_t)dataset.nrOfImages * sensorViewsX * sensorViewsY);
+    
+    threadPool->parallelFor(dataset.nrOfImages, [&](int digit, int thread)
+    {
+        uint16_t *view = &views[(size_t)digit * sensorViewsX * sensorViewsY];
+        
+        for (int x = 0; x < sensorViewsX; ++x)
+        {
+            for (int y = 0; y < sensorViewsY; ++y)
+            {
+                *view++ = (uint16_t)computeSensors(digit, sensorViewOriginX + x, sensorViewOriginY + y, 3, gridSizeX, gridSizeY);
+            }
+        }
+    });
+    
+    sensorViews.swap(views);
+    
+    // a fixed camera sees each digit the same at every step, so the digits only need to be told apart by that view
+    if (!allCameraPositions)
+    {
+        vector<int> allDigits(dataset.nrOfImages), groupOfView(1 << nrOfViewBits, -1);
+        
+        for (int digit = 0; digit < dataset.nrOfImages; ++digit)
+        {
+            allDigits[digit] = digit;
+        }
+        
+        groupDigits(allDigits.empty() ? NULL : &allDigits[0], (int)allDigits.size(), digitGroups, groupOfView);
+    }
+    
+    return true;
+}
+
+// groups the given digits by their view from the grid center, which buildSensorViews must have stored for a fixed camera.
+// groupOfView has to hold -1 for every view on entry and does again on return
+void tGame::groupDigits(const int *digits, int count, tDigitGroups &groups, vector<int> &groupOfView)
+{
+    groups.views.clear();
+    groups.labelCounts.clear();
+    
+    for (int counter = 0; counter < count; ++counter)
+    {
+        int view = sensorViews[digits[counter]];
+        
+        if (groupOfView[view] < 0)
+        {
+            groupOfView[view] = (int)groups.views.size();
+            groups.views.push_back((uint16_t)view);
+            groups.labelCounts.resize(groups.labelCounts.size() + nrOfLabelSlots, 0);
+        }
+        
+        int label = min((int)dataset.labels[digits[counter]], nrOfLabelSlots - 1);
+        groups.labelCounts[groupOfView[view] * nrOfLabelSlots + label] += 1;
+    }
+    
+    for (size_t group = 0; group < groups.views.size(); ++group)
+    {
+        groupOfView[groups.views[group]] = -1;
+    }
+}
+
 // runs the simulation for the given agent(s)
-string tGame::executeGame(tAgent* eddAgent, FILE *dataFile, bool report, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart, bool noise, float noiseAmount)
+// all randomness comes from rng and the game itself is read-only here,
+// so several agents can be evaluated at the same time on different threads,
+// each using its own scratch buffers (thread is the index the thread pool passes)
+// batch lists the digits to test the agent on; NULL tests it on all of them
+string tGame::executeGame(tAgent* eddAgent, tRNG &rng, FILE *dataFile, bool report, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart, bool noise, float noiseAmount, const vector<int> *batch, int thread)
+{
+    vector<int> &digits = scratch[thread].digits[0];
+    string reportString;
+    
+    startGame(eddAgent, rng, batch, digits);
+    
+    /*       BEGINNING OF SIMULATION LOOP       */
+    
+    if (report)
+    {
+        stringstream steps;
+        
+        for (int counter = 0; counter < digits.size(); ++counter)
+        {
+            playDigit(eddAgent, rng, digits[counter], &steps, gridSizeX, gridSizeY, zoomingCamera, randomStart);
+        }
+        
+        reportString = steps.str();
+    }
+#ifndef feedbackON
+    else if (eddAgent->brain->allDeterministic && !zoomingCamera && !randomStart && !digitGroups.views.empty())
+    {
+        // a brain of deterministic gates behind a fixed camera ends up the same on all digits that look the same,
+        // so it only has to be run once per distinct view
+        if (batch == NULL)
+        {
+            playDigitGroups(eddAgent, digitGroups);
+        }
+        else
+        {
+            tGameScratch &buffers = scratch[thread];
+            groupDigits(digits.empty() ? NULL : &digits[0], (int)digits.size(), buffers.groups, buffers.groupOfView);
+            playDigitGroups(eddAgent, buffers.groups);
+        }
+    }
+#endif
+    else if (!digits.empty())
+    {
+        playDigits(eddAgent, rng, &digits[0], (int)digits.size(), gridSizeX, gridSizeY, zoomingCamera, randomStart);
+    }
+    
+    /*       END OF SIMULATION LOOP       */
+    
+    finishGame(eddAgent, (int)digits.size(), dataFile);
+    
+    return reportString;
+}
+
+// evaluates the two agents of a tournament side by side, a chunk of digits at a time, each on its own random stream,
+// and stops evaluating an agent as soon as it could not beat its partner even with a perfect score on its remaining digits.
+// the agent still running is tested on all digits exactly like executeGame does, and the stopped one ends up with
+// a fitness below its partner's, so the tournament has the same outcome as with a full evaluation of both
+void tGame::raceGames(tAgent *agentA, tAgent *agentB, int chunkSize, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart, const vector<int> *batch, int thread)
 {
-    stringstream reportString;
+    tAgent *agents[2] = { agentA, agentB };
+    vector<int> *digits = scratch[thread].digits;
+    int played[2] = { 0, 0 };
+    bool racing[2] = { true, true };
+    
+    startGame(agentA, agentA->rng, batch, digits[0]);
+    startGame(agentB, agentB->rng, batch, digits[1]);
+    
+    int nrOfDigits = (int)digits[0].size();
+    
+    while ((racing[0] && played[0] < nrOfDigits) || (racing[1] && played[1] < nrOfDigits))
+    {
+        for (int a = 0; a < 2; ++a)
+        {
+            if (racing[a] && played[a] < nrOfDigits)
+            {
+                int count = min(chunkSize, nrOfDigits - played[a]);
+                playDigits(agents[a], agents[a]->rng, &digits[a][played[a]], count, gridSizeX, gridSizeY, zoomingCamera, randomStart);
+                played[a] += count;
+            }
+        }
+        
+        for (int a = 0; a < 2; ++a)
+        {
+            // a digit scores at most 1, so this is the best the agent can still reach;
+            // the partner's final score is at least its current one
+            // (the margin covers rounding, and the partner has to stay above the fitness floor of finishGame)
+            double bestReachable = agents[a]->classificationFitness + (nrOfDigits - played[a]);
+            double partnerScore = agents[1 - a]->classificationFitness;
+            
+            if (racing[a] && racing[1 - a] && bestReachable + 0.000001 < partnerScore && partnerScore / nrOfDigits > 0.000001)
+            {
+                racing[a] = false;
+            }
+        }
+    }
+    
+    finishGame(agentA, nrOfDigits, NULL);
+    finishGame(agentB, nrOfDigits, NULL);
+}
+
+// gives the agent a fitness already known from an earlier evaluation instead of running the simulation,
+// drawing the same random numbers from rng as executeGame; this is only the same as running it when
+// the simulation itself draws nothing, i.e. for brains of deterministic gates without a random camera start
+void tGame::skipGame(tAgent* eddAgent, tRNG &rng, const vector<int> *batch, double fitness, double classificationFitness, int thread)
+{
+    startGame(eddAgent, rng, batch, scratch[thread].digits[0]);
+    eddAgent->fitness = fitness;
+    eddAgent->classificationFitness = classificationFitness;
+}
 
+// prepares the agent for a run over the digits and lists them in the order it will see them
+void tGame::startGame(tAgent* eddAgent, tRNG &rng, const vector<int> *batch, vector<int> &digits)
+{
     // set up brain for EDD agent
     eddAgent->setupPhenotype();
     eddAgent->classificationFitness = 0.0;
     eddAgent->fitness = 0.0;
     
-    // edd agent camera variables
-    int cameraX = gridSizeX / 2.0, cameraY = gridSizeY / 2.0;
-    int cameraSize = 3;
-    
     for (int digit = 0; digit < 10; ++digit)
     {
         eddAgent->truePositives[digit] = 0;
@@ -201,294 +365,532 @@ string tGame::executeGame(tAgent* eddAgent, FILE *dataFile, bool report, int gri
         eddAgent->falseNegatives[digit] = 0;
     }
     
-    
-    /*       BEGINNING OF SIMULATION LOOP       */
-    
-    // test the edd agent on all digits in random order
-    vector<int> digits;
-    for (int digit = 0; digit < symbol_keys.size(); ++digit)
+    for (int guessed = 0; guessed <= 10; ++guessed)
     {
-        digits.push_back(digit);
+        eddAgent->correctGuesses[guessed] = 0;
     }
-    random_shuffle(digits.begin(), digits.end());
     
-    for (int counter = 0; counter < digits.size(); ++counter)
+    // test the edd agent on all digits (or the given batch of digits) in random order
+    digits.clear();
+    if (batch != NULL)
+    {
+        digits = *batch;
+    }
+    else
+    {
+        for (int digit = 0; digit < symbol_keys.size(); ++digit)
+        {
+            digits.push_back(digit);
+        }
+    }
+    rng.shuffle(digits);
+}
+
+// runs the simulation for the given digits one after the other, like playDigit does
+// a brain made of deterministic gates is run on up to 64 digits at once instead
+void tGame::playDigits(tAgent* eddAgent, tRNG &rng, const int *digits, int count, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart)
+{
+#ifndef feedbackON
+    if (eddAgent->brain->allDeterministic)
     {
-        int digit = digits[counter];
+        for (int first = 0; first < count; first += 64)
+        {
+            playDigitBatch(eddAgent, rng, digits + first, min(count - first, 64), gridSizeX, gridSizeY, zoomingCamera, randomStart);
+        }
         
-        eddAgent->resetBrain();
-        cameraX = gridSizeX / 2.0;
-        cameraY = gridSizeY / 2.0;
-        cameraSize = 3;
+        return;
+    }
+#endif
+    
+    for (int counter = 0; counter < count; ++counter)
+    {
+        playDigit(eddAgent, rng, digits[counter], NULL, gridSizeX, gridSizeY, zoomingCamera, randomStart);
+    }
+}
 
-	if (randomStart)
-	  {
-	    do
-	      {
-              cameraX = (int)(randDouble * gridSizeX);
-              cameraY = (int)(randDouble * gridSizeY);
-	      } while (cameraX == gridSizeX || cameraY == gridSizeY);
-	  }
+// runs the simulation for up to 64 digits in lockstep, with the brain states bit-sliced:
+// states[node] holds the node's value for every digit, digit i in bit i (its lane).
+// a lane drops out of the active mask once its done bit is set and keeps its states from then on.
+// gives the same results as playDigit on each digit in turn, since deterministic gates never draw from rng
+void tGame::playDigitBatch(tAgent* eddAgent, tRNG &rng, const int *digits, int count, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart)
+{
+    tBrain *brain = eddAgent->brain.get();
+    uint64_t states[maxNodes], newStates[maxNodes];
+    int cameraX[64], cameraY[64];
+    const int cameraSize = 3;
+    uint64_t active = (count == 64) ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1);
+    const int nrOfSensors = (MAX_CAM_SIZE * MAX_CAM_SIZE) + 4;
+    uint64_t sensorStates[nrOfSensors];
+    
+    for (int lane = 0; lane < count; ++lane)
+    {
+        cameraX[lane] = gridSizeX / 2.0;
+        cameraY[lane] = gridSizeY / 2.0;
         
-        if (report)
+        if (randomStart)
         {
-            int digitCenterX = (int)(gridSizeX / 2.0), digitCenterY = (int)(gridSizeY / 2.0);
-            
-	  reportString << symbol_keys[digit] << "," << digitCenterX << "," << digitCenterY << "," << gridSizeX << "," << gridSizeY << "\n";
+            cameraX[lane] = (int)rng.nextInt(gridSizeX);
+            cameraY[lane] = (int)rng.nextInt(gridSizeY);
+        }
+    }
+    
+    for (int node = 0; node < maxNodes; ++node)
+    {
+        states[node] = 0;
+    }
+    
+    for (int step = 0; step < totalStepsInSimulation && active != 0; ++step)
+    {
+        for (int sensor = 0; sensor < nrOfSensors; ++sensor)
+        {
+            sensorStates[sensor] = 0;
         }
         
-        for (int step = 0; step < totalStepsInSimulation; ++step)
+        for (uint64_t lanes = active; lanes != 0; lanes &= lanes - 1)
         {
+            int lane = __builtin_ctzll(lanes);
+            uint64_t sensors = readSensors(digits[lane], cameraX[lane], cameraY[lane], cameraSize, gridSizeX, gridSizeY);
             
-            /*       CREATE THE REPORT STRING FOR THE VIDEO       */
-            if (report)
+            for (; sensors != 0; sensors &= sensors - 1)
             {
-	      reportString << cameraX << "," << cameraY << "," << cameraSize;
+                sensorStates[__builtin_ctzll(sensors)] |= (uint64_t)1 << lane;
             }
-            /*       END OF REPORT STRING CREATION       */
-            
+        }
+        
+        // the camera only moves with the zooming camera, otherwise these sensors are all the lanes ever see
+        if (!zoomingCamera)
+        {
+            playFixedView(brain, states, sensorStates, active);
+            break;
+        }
+        
+        // clear all sensors and put the sensory values in the retinas
+        for (int sensor = 0; sensor < nrOfSensors; ++sensor)
+        {
+            states[sensor] = sensorStates[sensor];
+        }
+        
+        brain->updateSliced(states, newStates);
+        
+        // lanes that are done keep their last states
+        for (int node = 0; node < maxNodes; ++node)
+        {
+            states[node] = (newStates[node] & active) | (states[node] & ~active);
+        }
+        
+        for (uint64_t lanes = active; lanes != 0; lanes &= lanes - 1)
+        {
+            int lane = __builtin_ctzll(lanes);
             
-            /*       SAVE DATA FOR THE LOD FILE       */
-            if (dataFile != NULL)
+            // possible for up/down and left/right actuators to cancel each other out
+            if ((states[maxNodes - 1] >> lane) & 1) cameraY[lane] += 3;
+            if ((states[maxNodes - 2] >> lane) & 1) cameraY[lane] -= 3;
+            if ((states[maxNodes - 4] >> lane) & 1) cameraX[lane] += 3;
+            if ((states[maxNodes - 3] >> lane) & 1) cameraX[lane] -= 3;
+        }
+        
+        active &= ~states[maxNodes - 5];
+    }
+    
+    // score the lanes in order, gathering each lane's states back into one word
+    for (int lane = 0; lane < count; ++lane)
+    {
+        uint64_t laneStates = 0;
+        
+        for (int node = 0; node < maxNodes; ++node)
+        {
+            laneStates |= ((states[node] >> lane) & 1) << node;
+        }
+        
+        scoreDigit(eddAgent, digits[lane], laneStates);
+    }
+}
+
+// runs the simulation with a fixed camera once for every view of the groups, 64 views at a time like playDigitBatch does,
+// and scores each view for every label as often as there are digits of that label with that view.
+// the statistics come out the same as from playing the digits one by one, only the running classificationFitness
+// is added up in a different order (finishGame adds it up anew anyway)
+void tGame::playDigitGroups(tAgent* eddAgent, const tDigitGroups &groups)
+{
+    tBrain *brain = eddAgent->brain.get();
+    uint64_t states[maxNodes];
+    const int nrOfSensors = (MAX_CAM_SIZE * MAX_CAM_SIZE) + 4;
+    uint64_t sensorStates[nrOfSensors];
+    int nrOfViews = (int)groups.views.size();
+    
+    for (int first = 0; first < nrOfViews; first += 64)
+    {
+        int count = min(nrOfViews - first, 64);
+        uint64_t active = (count == 64) ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1);
+        
+        for (int sensor = 0; sensor < nrOfSensors; ++sensor)
+        {
+            sensorStates[sensor] = 0;
+        }
+        
+        for (int lane = 0; lane < count; ++lane)
+        {
+            for (uint64_t sensors = groups.views[first + lane]; sensors != 0; sensors &= sensors - 1)
             {
-                
+                sensorStates[__builtin_ctzll(sensors)] |= (uint64_t)1 << lane;
             }
-            /*       END OF DATA GATHERING       */
+        }
+        
+        for (int node = 0; node < maxNodes; ++node)
+        {
+            states[node] = 0;
+        }
+        
+        playFixedView(brain, states, sensorStates, active);
+        
+        for (int lane = 0; lane < count; ++lane)
+        {
+            uint64_t laneStates = 0;
             
-            // clear all sensors
-            for (int sensor = 0; sensor < (MAX_CAM_SIZE * MAX_CAM_SIZE) + 4; ++sensor)
+            for (int node = 0; node < maxNodes; ++node)
             {
-                eddAgent->states[sensor] = 0;
+                laneStates |= ((states[node] >> lane) & 1) << node;
             }
             
-            // put sensory values in edd agent's retina
-            // by default, edd agent has 3x3 retina:
+            const int *labelCounts = &groups.labelCounts[(first + lane) * nrOfLabelSlots];
             
-            // x x x
-            // x x x
-            // x x x
-            
-            // can zoom out to 5x5, 7x7, etc.
-            
-            // to maintain same order of inputs, start counting sensors from the inside.
-            // e.g. for 7x7:
-            
-            // 43 42 41 40 39 38 37
-            // 44 21 20 19 18 17 36
-            // 45 22 7  6  5  16 35
-            // 46 23 8  0  4  15 34
-            // 47 24 1  2  3  14 33
-            // 48 9  10 11 12 13 32
-            // 25 26 27 28 29 30 31
-            
-            for (int sensor = 0; sensor < cameraSize * cameraSize; ++sensor)
+            // the last slot is scored with a label no classify bit stands for, like any label beyond 9
+            for (int label = 0; label < nrOfLabelSlots; ++label)
             {
-                int sensorX = cameraX + sensorOffsetMap[sensor][0];
-                int sensorY = cameraY + sensorOffsetMap[sensor][1];
-                
-                if (sensorX >= 0 && sensorX < gridSizeX && sensorY >= 0 && sensorY < gridSizeY)
+                if (labelCounts[label] > 0)
                 {
-                    if (digitGrid[digit][sensorX][sensorY] == 1)
-                    {
-                        eddAgent->states[sensor] = 1;
-                    }
+                    scoreLabel(eddAgent, label, laneStates, labelCounts[label]);
                 }
             }
+        }
+    }
+}
 
-	    // raycast periphery sensors
-            // these are 4 raycast sensors that project from the 4 sides of the agent
-	    // possibly useful for finding the digit and orienting itself
-
-	    int curX = 0, curY = 0;
-
-	    // top sensor
-	    for (curX = cameraX, curY = cameraY + 2; curY < gridSizeY; ++curY)
-	      {
-		// if the current position is outside of the grid, skip it
-		if (curY < 0 || curY >= gridSizeY) continue;
-		if (curX < 0 || curX >= gridSizeX) break;
-
-		if (digitGrid[digit][curX][curY] == 1)
-		  {
-		    eddAgent->states[9] = 1;
-		    break;
-		  }
-	      }
-
-	    // bottom sensor
-	    for (curX = cameraX, curY = cameraY - 2; curY >= 0; --curY)
-	      {
-		// if the current position is outside of the grid, skip it
-		if (curY < 0 || curY >= gridSizeY) continue;
-		if (curX < 0 || curX >= gridSizeX) break;
-
-		if (digitGrid[digit][curX][curY] == 1)
-                  {
-                    eddAgent->states[10] = 1;
-                    break;
-                  }
-              }
-
-	    // right sensor
-            for (curX = cameraX + 2, curY = cameraY; curX < gridSizeX; ++curX)
-	      {
-		// if the current position is outside of the grid, skip it
-		if (curX < 0 || curX >= gridSizeX) continue;
-                if (curY < 0 || curY >= gridSizeY) break;
-		
-		if (digitGrid[digit][curX][curY] == 1)
-                  {
-                    eddAgent->states[11] = 1;
-                    break;
-                  }
-              }
+// runs the bit-sliced simulation of playDigitBatch from the start for lanes whose sensors show the same at every step.
+// the brain is then a finite state machine on the nodes that are not sensors, so a lane whose states repeat
+// stays in that loop up to the last step: a lane back at the states of the step before (a fixed point) or of
+// the step before that (a cycle of two steps) gets the states it would have at the last step straight away
+// and drops out of the active mask, the same as a lane whose done bit is set
+void tGame::playFixedView(tBrain *brain, uint64_t *states, const uint64_t *sensorStates, uint64_t active)
+{
+    const int nrOfSensors = (MAX_CAM_SIZE * MAX_CAM_SIZE) + 4;
+    uint64_t newStates[maxNodes], previousStates[maxNodes];
+    
+    for (int node = 0; node < maxNodes; ++node)
+    {
+        previousStates[node] = 0;
+    }
+    
+    for (int step = 0; step < totalStepsInSimulation && active != 0; ++step)
+    {
+        for (int sensor = 0; sensor < nrOfSensors; ++sensor)
+        {
+            states[sensor] = sensorStates[sensor];
+        }
+        
+        brain->updateSliced(states, newStates);
+        
+        // the sensors are put back before every update, so only the other nodes tell whether a lane repeats itself
+        uint64_t changed = 0, changedSincePrevious = 0;
+        
+        for (int node = nrOfSensors; node < maxNodes; ++node)
+        {
+            changed |= newStates[node] ^ states[node];
+            changedSincePrevious |= newStates[node] ^ previousStates[node];
+        }
+        
+        uint64_t settled = active & ~changed;
+        uint64_t alternating = (step > 0) ? (active & changed & ~changedSincePrevious) : 0;
+        
+        // an alternating lane ends up in its current states if an odd number of updates is left after this one
+        uint64_t keep = ((totalStepsInSimulation - step - 1) % 2 == 1) ? alternating : 0;
+        uint64_t update = active & ~keep;
+        
+        // lanes that are done (and alternating lanes that end up where they are) keep their states
+        for (int node = 0; node < maxNodes; ++node)
+        {
+            previousStates[node] = states[node];
+            states[node] = (newStates[node] & update) | (states[node] & ~update);
+        }
+        
+        active &= ~(states[maxNodes - 5] | settled | alternating);
+    }
+}
 
-            // left sensor
-	    for (curX = cameraX - 2, curY = cameraY; curX >= 0; --curX)
-              {
-		// if the current position is outside of the grid, skip it
-		if (curX < 0 || curX >= gridSizeX) continue;
-		if (curY < 0 || curY >= gridSizeY) break;
-		
-                if (digitGrid[digit][curX][curY] == 1)
-                  {
-                    eddAgent->states[12] = 1;
-                    break;
-                  }
-              }
-            
-            // activate the edd agent's brain
-	    eddAgent->updateStates();
-                        
-            // get edd agent's action
-            // possible actions:
-            //      move up/down: 2
-            //      move left/right: 2
-            //      zoom in: 1
-            //      zoom out: 1
-            //      classify (0-9): 10
-            //      veto bits (0-9): 10
-            //      TODO: "I'm ready" bit: 1
-            
-            int moveUp = eddAgent->states[(maxNodes - 1)] & 1;
-            int moveDown = eddAgent->states[(maxNodes - 2)] & 1;
-            int moveLeft = eddAgent->states[(maxNodes - 3)] & 1;
-            int moveRight = eddAgent->states[(maxNodes - 4)] & 1;
-            //int zoomIn = eddAgent->states[(maxNodes - 5)] & 1;
-	    //int zoomOut = eddAgent->states[(maxNodes - 6)] & 1;
-	    int doneBit = eddAgent->states[(maxNodes - 5)] & 1;
-
-            // edd agent can move the camera
-            // possible for up/down and left/right actuators to cancel each other out
-            if (zoomingCamera && moveUp) cameraY += 3;
-            if (zoomingCamera && moveDown) cameraY -= 3;
-            if (zoomingCamera && moveRight) cameraX += 3;
-            if (zoomingCamera && moveLeft) cameraX -= 3;
+// runs the simulation for one digit and adds the result to the agent's statistics
+void tGame::playDigit(tAgent* eddAgent, tRNG &rng, int digit, stringstream *reportString, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart)
+{
+    // edd agent camera variables
+    int cameraX = gridSizeX / 2.0, cameraY = gridSizeY / 2.0;
+    int cameraSize = 3;
+    
+    eddAgent->resetBrain();
 
-	    if (report)
+	if (randomStart)
+	  {
+	    cameraX = (int)rng.nextInt(gridSizeX);
+	    cameraY = (int)rng.nextInt(gridSizeY);
+	  }
+    
+    if (reportString != NULL)
+    {
+        int digitCenterX = (int)(gridSizeX / 2.0), digitCenterY = (int)(gridSizeY / 2.0);
+        
+	  *reportString << symbol_keys[digit] << "," << digitCenterX << "," << digitCenterY << "," << gridSizeX << "," << gridSizeY << "\n";
+    }
+    
+    for (int step = 0; step < totalStepsInSimulation; ++step)
+    {
+        
+        /*       CREATE THE REPORT STRING FOR THE VIDEO       */
+        if (reportString != NULL)
+        {
+	      *reportString << cameraX << "," << cameraY << "," << cameraSize;
+        }
+        /*       END OF REPORT STRING CREATION       */
+        
+        
+        // clear all sensors and put the sensory values in the edd agent's retina
+        eddAgent->states &= ~(((uint64_t)1 << ((MAX_CAM_SIZE * MAX_CAM_SIZE) + 4)) - 1);
+        eddAgent->states |= readSensors(digit, cameraX, cameraY, cameraSize, gridSizeX, gridSizeY);
+        
+        // activate the edd agent's brain
+	    eddAgent->updateStates(rng);
+                    
+        // get edd agent's action
+        // possible actions:
+        //      move up/down: 2
+        //      move left/right: 2
+        //      zoom in: 1
+        //      zoom out: 1
+        //      classify (0-9): 10
+        //      veto bits (0-9): 10
+        //      TODO: "I'm ready" bit: 1
+        
+        int moveUp = (eddAgent->states >> (maxNodes - 1)) & 1;
+        int moveDown = (eddAgent->states >> (maxNodes - 2)) & 1;
+        int moveLeft = (eddAgent->states >> (maxNodes - 3)) & 1;
+        int moveRight = (eddAgent->states >> (maxNodes - 4)) & 1;
+        //int zoomIn = (eddAgent->states >> (maxNodes - 5)) & 1;
+	    //int zoomOut = (eddAgent->states >> (maxNodes - 6)) & 1;
+	    int doneBit = (eddAgent->states >> (maxNodes - 5)) & 1;
+
+        // edd agent can move the camera
+        // possible for up/down and left/right actuators to cancel each other out
+        if (zoomingCamera && moveUp) cameraY += 3;
+        if (zoomingCamera && moveDown) cameraY -= 3;
+        if (zoomingCamera && moveRight) cameraX += 3;
+        if (zoomingCamera && moveLeft) cameraX -= 3;
+
+	    if (reportString != NULL)
 	      {
 		// parse edd agent classifications
 		int classifyDigit[10];
 		for (int i = 0; i < 10; ++i)
 		  {
-		    classifyDigit[i] = eddAgent->states[(maxNodes - 7 - i)] & 1;
+		    classifyDigit[i] = (eddAgent->states >> (maxNodes - 7 - i)) & 1;
 		  }
 
 		int vetoBits[10];
 		for (int i = 0; i < 10; ++i)
 		  {
-		    vetoBits[i] = eddAgent->states[(maxNodes - 17 - i)] & 1;
+		    vetoBits[i] = (eddAgent->states >> (maxNodes - 17 - i)) & 1;
 		  }
 		for (int i = 0; i < 10; ++i)
+              {
+                if (classifyDigit[i] == 1 && vetoBits[i] == 0)
                   {
-                    if (classifyDigit[i] == 1 && vetoBits[i] == 0)
-                      {
-                        reportString << "," << i;
-                      }
+                    *reportString << "," << i;
                   }
-		reportString << "\n";
+              }
+		*reportString << "\n";
 	      }
 
 	    if (doneBit) break;
 	}
+    
+    if (reportString != NULL)
+    {
+        *reportString << "X\n";
+    }
+    
+    scoreDigit(eddAgent, digit, eddAgent->states);
+}
+
+// the 13 sensor bits the camera at the given position sees of the digit, read from the digit itself
+uint64_t tGame::computeSensors(int digit, int cameraX, int cameraY, int cameraSize, int gridSizeX, int gridSizeY)
+{
+    uint64_t sensors = 0;
+    
+    // put sensory values in edd agent's retina
+    // by default, edd agent has 3x3 retina:
+    
+    // x x x
+    // x x x
+    // x x x
+    
+    // can zoom out to 5x5, 7x7, etc.
+    
+    // to maintain same order of inputs, start counting sensors from the inside.
+    // e.g. for 7x7:
+    
+    // 43 42 41 40 39 38 37
+    // 44 21 20 19 18 17 36
+    // 45 22 7  6  5  16 35
+    // 46 23 8  0  4  15 34
+    // 47 24 1  2  3  14 33
+    // 48 9  10 11 12 13 32
+    // 25 26 27 28 29 30 31
+    
+    for (int sensor = 0; sensor < cameraSize * cameraSize; ++sensor)
+    {
+        int sensorX = cameraX + sensorOffsetMap[sensor][0];
+        int sensorY = cameraY + sensorOffsetMap[sensor][1];
         
-        if (report)
+        if (sensorX >= 0 && sensorX < gridSizeX && sensorY >= 0 && sensorY < gridSizeY)
         {
-            reportString << "X\n";
+            if (digitPixel(digit, sensorX, sensorY))
+            {
+                sensors |= (uint64_t)1 << sensor;
+            }
         }
-        
-        // parse edd agent classifications
-        int classifyDigit[10];
-        for (int i = 0; i < 10; ++i)
+    }
+    
+    // raycast periphery sensors
+    // these are 4 raycast sensors that project from the 4 sides of the agent
+    // possibly useful for finding the digit and orienting itself
+    
+    // each ray sees the first set pixel between the camera's edge and the edge of the grid;
+    // a camera outside of the grid along the ray's row or column sees nothing
+    
+    // top sensor
+    if (cameraX >= 0 && cameraX < gridSizeX && rowHasPixel(digit, cameraX, max(cameraY + 2, 0), gridSizeY))
+    {
+        sensors |= (uint64_t)1 << 9;
+    }
+    
+    // bottom sensor
+    if (cameraX >= 0 && cameraX < gridSizeX && rowHasPixel(digit, cameraX, 0, min(cameraY - 1, gridSizeY)))
+    {
+        sensors |= (uint64_t)1 << 10;
+    }
+    
+    // right sensor
+    if (cameraY >= 0 && cameraY < gridSizeY && columnHasPixel(digit, cameraY, max(cameraX + 2, 0), gridSizeX))
+    {
+        sensors |= (uint64_t)1 << 11;
+    }
+    
+    // left sensor
+    if (cameraY >= 0 && cameraY < gridSizeY && columnHasPixel(digit, cameraY, 0, min(cameraX - 1, gridSizeX)))
+    {
+        sensors |= (uint64_t)1 << 12;
+    }
+    
+    return sensors;
+}
+
+// adds the classification the brain states hold at the end of a digit to the agent's statistics
+void tGame::scoreDigit(tAgent* eddAgent, int digit, uint64_t states)
+{
+    scoreLabel(eddAgent, dataset.labels[digit], states, 1);
+}
+
+// adds the classification the brain states hold at the end of count digits with the given label to the agent's statistics
+void tGame::scoreLabel(tAgent* eddAgent, int label, uint64_t states, int count)
+{
+    // parse edd agent classifications
+    int classifyDigit[10];
+    for (int i = 0; i < 10; ++i)
+    {
+        classifyDigit[i] = (states >> (maxNodes - 7 - i)) & 1;
+    }
+    
+    int vetoBits[10];
+    for (int i = 0; i < 10; ++i)
+    {
+        vetoBits[i] = (states >> (maxNodes - 17 - i)) & 1;
+    }
+    
+    // check accuracy of edd agent classifications
+    float score = 0.0;
+    float numDigitsGuessed = 0.0;
+    
+    for (int i = 0; i < 10; ++i)
+    {
+        bool guessedThisDigit = (classifyDigit[i] == 1 && vetoBits[i] == 0);
+	    int correct_digit = label;
+
+        if (guessedThisDigit)
         {
-            classifyDigit[i] = eddAgent->states[(maxNodes - 7 - i)] & 1;
+            numDigitsGuessed += 1.0;
         }
         
-        int vetoBits[10];
-        for (int i = 0; i < 10; ++i)
+        if (guessedThisDigit && i == correct_digit)
         {
-            vetoBits[i] = eddAgent->states[(maxNodes - 17 - i)] & 1;
+            // true positive
+            eddAgent->truePositives[i] += count;
+            score = 1.0;
         }
         
-        // check accuracy of edd agent classifications
-        float score = 0.0;
-        float numDigitsGuessed = 0.0;
+        else if (guessedThisDigit && i != correct_digit)
+        {
+            // false positive
+            eddAgent->falsePositives[i] += count;
+        }
         
-        for (int i = 0; i < 10; ++i)
+        else if (!guessedThisDigit && i == correct_digit)
         {
-            bool guessedThisDigit = (classifyDigit[i] == 1 && vetoBits[i] == 0);
-	    int correct_digit = symbol_labels[digit];
-
-            if (guessedThisDigit)
-            {
-                numDigitsGuessed += 1.0;
-            }
-            
-            if (guessedThisDigit && i == correct_digit)
-            {
-                // true positive
-                eddAgent->truePositives[i] += 1;
-                score = 1.0;
-            }
-            
-            else if (guessedThisDigit && i != correct_digit)
-            {
-                // false positive
-                eddAgent->falsePositives[i] += 1;
-            }
-            
-            else if (!guessedThisDigit && i == correct_digit)
-            {
-                // false negative
-                eddAgent->falseNegatives[i] += 1;
-            }
-            
-            else if (!guessedThisDigit && i != correct_digit)
-            {
-                // true negative
-                eddAgent->trueNegatives[i] += 1;
-            }
+            // false negative
+            eddAgent->falseNegatives[i] += count;
         }
         
-        if (numDigitsGuessed > 0.0)
+        else if (!guessedThisDigit && i != correct_digit)
         {
-            eddAgent->classificationFitness += score / numDigitsGuessed;
+            // true negative
+            eddAgent->trueNegatives[i] += count;
         }
     }
     
-    /*       END OF SIMULATION LOOP       */
-    
+    if (numDigitsGuessed > 0.0)
+    {
+        // the running total is what racing goes by; the final one is added up by finishGame
+        eddAgent->classificationFitness += count * (score / numDigitsGuessed);
+        
+        if (score > 0.0)
+        {
+            eddAgent->correctGuesses[(int)numDigitsGuessed] += count;
+        }
+    }
+}
+
+// turns the agent's statistics over the given number of digits into its fitness
+void tGame::finishGame(tAgent* eddAgent, int nrOfDigits, FILE *dataFile)
+{
     // compute TPR and TNR
+    // (a batch may not contain every digit, which leaves the rates of the missing ones at 0)
     for (int digit = 0; digit < 10; ++digit)
     {
-        eddAgent->truePositiveRate[digit] = eddAgent->truePositives[digit] / (eddAgent->truePositives[digit] + eddAgent->falseNegatives[digit]);
+        int positives = eddAgent->truePositives[digit] + eddAgent->falseNegatives[digit];
+        int negatives = eddAgent->trueNegatives[digit] + eddAgent->falsePositives[digit];
+        
+        eddAgent->truePositiveRate[digit] = (positives > 0) ? eddAgent->truePositives[digit] / positives : 0;
         
-        eddAgent->trueNegativeRate[digit] = eddAgent->trueNegatives[digit] / (eddAgent->trueNegatives[digit] + eddAgent->falsePositives[digit]);
+        eddAgent->trueNegativeRate[digit] = (negatives > 0) ? eddAgent->trueNegatives[digit] / negatives : 0;
+    }
+    
+    // add the scores up in a fixed order, so the fitness does not depend on the order the digits were played in
+    // (an agent with deterministic gates then gets exactly the same fitness every time it is tested on the same digits)
+    eddAgent->classificationFitness = 0.0;
+    
+    for (int guessed = 1; guessed <= 10; ++guessed)
+    {
+        eddAgent->classificationFitness += eddAgent->correctGuesses[guessed] * (double)(1.0f / (float)guessed);
     }
     
     // compute overall fitness
-    eddAgent->fitness = eddAgent->classificationFitness / (float)(symbol_keys.size());
-    eddAgent->classificationFitness /= (float)(symbol_keys.size());
+    eddAgent->fitness = eddAgent->classificationFitness / (float)(nrOfDigits);
+    eddAgent->classificationFitness /= (float)(nrOfDigits);
     
     // don't allow fitness to be 0 nor negative
     if (eddAgent->fitness <= 0.0)
@@ -506,30 +908,54 @@ string tGame::executeGame(tAgent* eddAgent, FILE *dataFile, bool report, int gri
     }
 
     //cout << eddAgent->fitness << endl;
+}
 
-    return reportString.str();
+// whether the pixel at grid position (x, y) of the given digit is set
+bool tGame::digitPixel(int digit, int x, int y)
+{
+    x -= digitOffsetX;
+    y -= digitOffsetY;
+    
+    return x >= 0 && x < dataset.sizeX && y >= 0 && y < dataset.sizeY && dataset.pixel(digit, x, y);
 }
 
-// place the given digit on the digitGrid at the given point (digitCenterX, digitCenterY)
-void tGame::placeDigit(vector< vector< vector<int> > > &digitGrid, int symbol_key_index, int digitCenterX, int digitCenterY)
+// whether any pixel of the given digit is set in grid row x between columns [fromY, toY)
+bool tGame::rowHasPixel(int digit, int x, int fromY, int toY)
 {
-    for (int i = 0; i < digitGrid[symbol_key_index].size(); ++i)
+    x -= digitOffsetX;
+    fromY = max(fromY - digitOffsetY, 0);
+    toY = min(toY - digitOffsetY, dataset.sizeY);
+    
+    if (x < 0 || x >= dataset.sizeX || fromY >= toY)
     {
-        for (int j = 0; j < digitGrid[symbol_key_index][i].size(); ++j)
+        return false;
+    }
+    
+    // the row is one contiguous run of bits
+    return dataset.anyPixel(digit, x * dataset.sizeY + fromY, x * dataset.sizeY + toY);
+}
+
+// whether any pixel of the given digit is set in grid column y between rows [fromX, toX)
+bool tGame::columnHasPixel(int digit, int y, int fromX, int toX)
+{
+    y -= digitOffsetY;
+    fromX = max(fromX - digitOffsetX, 0);
+    toX = min(toX - digitOffsetX, dataset.sizeX);
+    
+    if (y < 0 || y >= dataset.sizeY)
+    {
+        return false;
+    }
+    
+    for (int x = fromX; x < toX; ++x)
+    {
+        if (dataset.pixel(digit, x, y))
         {
-            digitGrid[symbol_key_index][i][j] = 0;
+            return true;
         }
     }
-
-    string key = symbol_keys[symbol_key_index];
-
-    for (int i = 0; i < symbols[key].size(); ++i)
-      {
-	for (int j = 0; j < symbols[key][i].size(); ++j)
-	  {
-	    digitGrid[symbol_key_index][digitCenterX - 14 + i][digitCenterY - 14 + j] = symbols[key][i][j];
-	  }
-      }
+    
+    return false;
 }
 
 // sums a vector of values
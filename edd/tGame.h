@@ -24,20 +24,105 @@
 
 #include "globalConst.h"
 #include "tAgent.h"
+#include "tRNG.h"
+#include "tDataset.h"
+#include "tThreadPool.h"
 #include <vector>
 #include <map>
 #include <set>
 #include <string>
+#include <sstream>
+#include <algorithm>
 
 using namespace std;
 
+// digits grouped by what a camera fixed at the grid center sees of them:
+// every distinct view (the 13 sensor bits) once, with how many of the digits of each label look like that
+struct tDigitGroups{
+    vector<uint16_t> views;
+    // nrOfLabelSlots per view: one for each of the labels 0 to 9, and the last for all labels that name no digit
+    // (a digit file may hold any label from 0 to 255; such digits are never classified correctly)
+    vector<int> labelCounts;
+};
+
+#define     nrOfLabelSlots      11
+
+// buffers an evaluation thread reuses from one agent to the next, so that evaluating allocates nothing
+struct tGameScratch{
+    // the digits in the order the agent (or each agent of a race) sees them
+    vector<int> digits[2];
+    // the digits of a batch grouped by view, and each view's group (-1 for views not in the batch)
+    tDigitGroups groups;
+    vector<int> groupOfView;
+};
+
 class tGame
 {
 public:
-    string executeGame(tAgent* eddAgent, FILE *dataFile, bool report, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart, bool noise, float noiseAmount);
-    tGame(int gridSizeX, int gridSizeY);
+    // each sensor's (x, y) offset from the center of the camera
+    vector< vector<int> > sensorOffsetMap;
+    
+    vector<string> symbol_keys;
+    
+    // the digits, bit-packed, one image and label per symbol key
+    tDataset dataset;
+    
+    // grid position of pixel (0, 0) of every digit; the digits are centered in the grid
+    int digitOffsetX, digitOffsetY;
+    
+    // the 13 sensor bits of a 3x3 camera for every digit and camera position in
+    // [sensorViewOriginX, sensorViewOriginX + sensorViewsX) x [sensorViewOriginY, sensorViewOriginY + sensorViewsY),
+    // digit by digit; when sensorViewsClamped, positions outside the range see the same as the nearest one inside
+    vector<uint16_t> sensorViews;
+    int sensorViewOriginX, sensorViewOriginY, sensorViewsX, sensorViewsY;
+    bool sensorViewsClamped;
+    
+    // with a fixed camera, all digits grouped by view; empty otherwise
+    tDigitGroups digitGroups;
+    
+    vector<tGameScratch> scratch;
+    
+    string executeGame(tAgent* eddAgent, tRNG &rng, FILE *dataFile, bool report, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart, bool noise, float noiseAmount, const vector<int> *batch, int thread);
+    void raceGames(tAgent *agentA, tAgent *agentB, int chunkSize, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart, const vector<int> *batch, int thread);
+    void skipGame(tAgent* eddAgent, tRNG &rng, const vector<int> *batch, double fitness, double classificationFitness, int thread);
+    void startGame(tAgent* eddAgent, tRNG &rng, const vector<int> *batch, vector<int> &digits);
+    void playDigit(tAgent* eddAgent, tRNG &rng, int digit, stringstream *reportString, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart);
+    void playDigits(tAgent* eddAgent, tRNG &rng, const int *digits, int count, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart);
+    void playDigitBatch(tAgent* eddAgent, tRNG &rng, const int *digits, int count, int gridSizeX, int gridSizeY, bool zoomingCamera, bool randomStart);
+    void playDigitGroups(tAgent* eddAgent, const tDigitGroups &groups);
+    void playFixedView(tBrain *brain, uint64_t *states, const uint64_t *sensorStates, uint64_t active);
+    void groupDigits(const int *digits, int count, tDigitGroups &groups, vector<int> &groupOfView);
+    bool buildSensorViews(int gridSizeX, int gridSizeY, bool allCameraPositions, size_t maxBytes, tThreadPool *threadPool);
+    
+    // the 13 sensor bits the camera at the given position sees of the digit
+    inline uint64_t readSensors(int digit, int cameraX, int cameraY, int cameraSize, int gridSizeX, int gridSizeY)
+    {
+        int x = cameraX - sensorViewOriginX, y = cameraY - sensorViewOriginY;
+        
+        if (sensorViewsClamped)
+        {
+            x = min(max(x, 0), sensorViewsX - 1);
+            y = min(max(y, 0), sensorViewsY - 1);
+        }
+        
+        if (cameraSize == 3 && x >= 0 && x < sensorViewsX && y >= 0 && y < sensorViewsY)
+        {
+            return sensorViews[((size_t)digit * sensorViewsX + x) * sensorViewsY + y];
+        }
+        
+        return computeSensors(digit, cameraX, cameraY, cameraSize, gridSizeX, gridSizeY);
+    }
+    
+    uint64_t computeSensors(int digit, int cameraX, int cameraY, int cameraSize, int gridSizeX, int gridSizeY);
+    void scoreDigit(tAgent* eddAgent, int digit, uint64_t states);
+    void scoreLabel(tAgent* eddAgent, int label, uint64_t states, int count);
+    void finishGame(tAgent* eddAgent, int nrOfDigits, FILE *dataFile);
+    tGame(const char *datasetFileName, int gridSizeX, int gridSizeY);
     ~tGame();
-    void placeDigit(vector< vector< vector<int> > > &digitGrid, int symbol_key_index, int digitCenterX, int digitCenterY);
+    void setupThreads(int nrOfThreads);
+    bool digitPixel(int digit, int x, int y);
+    bool rowHasPixel(int digit, int x, int fromY, int toY);
+    bool columnHasPixel(int digit, int y, int fromX, int toX);
     double sum(vector<double> values);
     double average(vector<double> values);
     double variance(vector<double> values);
@@ -21,60 +21,58 @@
 
 #include <stdlib.h>
 #include "tHMM.h"
-//#define feedbackON
 
 tHMMU::tHMMU(){
+	deterministic=false;
+	start=0;
+	length=0;
+	_xDim=_yDim=0;
+#ifdef feedbackON
+	nrOfChosen=0;
+#endif
 }
 
-tHMMU::~tHMMU(){
-	hmm.clear();
-	sums.clear();
-	ins.clear();
-	outs.clear();
-	posLevelOfFB.clear();
-	negLevelOfFB.clear();
-	chosenInPos.clear();
-	chosenInNeg.clear();
-	chosenOutPos.clear();
-	chosenOutNeg.clear();
-}
-
-// set up stochastic gate
-void tHMMU::setup(vector<unsigned char> &genome, int start){
-	int i,j,k;
-	ins.clear();
-	outs.clear();
+// read the gate's dimensions and nodes, shared by both kinds of gates;
+// returns the genome position of the table
+int tHMMU::setupHeader(vector<unsigned char> &genome, int start){
+	int i,k;
+	this->start=start;
 	k=(start+2)%(int)genome.size();
 
 	_xDim=1+(genome[(k++)%genome.size()]&3);
 	_yDim=1+(genome[(k++)%genome.size()]&3);
+#ifdef feedbackON
 	posFBNode=genome[(k++)%genome.size()]&(maxNodes-1);
 	negFBNode=genome[(k++)%genome.size()]&(maxNodes-1);
 	nrPos=genome[(k++)%genome.size()]&3;
 	nrNeg=genome[(k++)%genome.size()]&3;
+#else
+	k+=4;
+#endif
 	//cout<<"setup "<<(int)genome[start+2]<<" "<<(int)xDim<<" "<<(int)yDim<<endl;
-	ins.resize(_yDim);
-	outs.resize(_xDim);
-	posLevelOfFB.resize(nrPos);
-	negLevelOfFB.resize(nrNeg);
+	// start codon, 6 header nucleotides, 16 for the node lists and the probability table
+	length=24+(1<<(_xDim+_yDim));
 	for(i=0;i<_yDim;i++)
 		ins[i]=genome[(k+i)%genome.size()]&(maxNodes-1);
 	for(i=0;i<_xDim;i++)
 		outs[i]=genome[(k+4+i)%genome.size()]&(maxNodes-1);
+#ifdef feedbackON
 	for(i=0;i<nrPos;i++)
 		posLevelOfFB[i]=(int)(1+genome[(k+8+i)%genome.size()]);
 	for(i=0;i<nrNeg;i++)
 		negLevelOfFB[i]=(int)(1+genome[(k+12+i)%genome.size()]);
-	chosenInPos.clear();
-	chosenInNeg.clear();
-	chosenOutPos.clear();
-	chosenOutNeg.clear();
-	
-	k=k+16;
-	hmm.resize(1<<_yDim);
-	sums.resize(1<<_yDim);
+	nrOfChosen=0;
+#endif
+	return k+16;
+}
+
+// set up stochastic gate
+void tHMMU::setup(vector<unsigned char> &genome, int start){
+	int i,j,k;
+	deterministic=false;
+	k=setupHeader(genome,start);
 	for(i=0;i<(1<<_yDim);i++){
-		hmm[i].resize(1<<_xDim);
+		sums[i]=0;
 		for(j=0;j<(1<<_xDim);j++){
 //			hmm[i][j]=(genome[(k+j+((1<<yDim)*i))%genome.size()]&1)*255;
 			hmm[i][j]=genome[(k+j+((1<<_xDim)*i))%genome.size()];
@@ -87,40 +85,10 @@ void tHMMU::setup(vector<unsigned char> &genome, int start){
 // set up deterministic gate
 void tHMMU::setupDeterministic(vector<unsigned char> &genome, int start){
 	int i,j,k;
-	ins.clear();
-	outs.clear();
-	k=(start+2)%(int)genome.size();
-	
-	_xDim=1+(genome[(k++)%genome.size()]&3);
-	_yDim=1+(genome[(k++)%genome.size()]&3);
-	posFBNode=genome[(k++)%genome.size()]&(maxNodes-1);
-	negFBNode=genome[(k++)%genome.size()]&(maxNodes-1);
-	nrPos=genome[(k++)%genome.size()]&3;
-	nrNeg=genome[(k++)%genome.size()]&3;
-	//cout<<"setup "<<(int)genome[start+2]<<" "<<(int)xDim<<" "<<(int)yDim<<endl;
-	ins.resize(_yDim);
-	outs.resize(_xDim);
-	posLevelOfFB.resize(nrPos);
-	negLevelOfFB.resize(nrNeg);
-	for(i=0;i<_yDim;i++)
-		ins[i]=genome[(k+i)%genome.size()]&(maxNodes-1);
-	for(i=0;i<_xDim;i++)
-		outs[i]=genome[(k+4+i)%genome.size()]&(maxNodes-1);
-	for(i=0;i<nrPos;i++)
-		posLevelOfFB[i]=(int)(1+genome[(k+8+i)%genome.size()]);
-	for(i=0;i<nrNeg;i++)
-		negLevelOfFB[i]=(int)(1+genome[(k+12+i)%genome.size()]);
-	chosenInPos.clear();
-	chosenInNeg.clear();
-	chosenOutPos.clear();
-	chosenOutNeg.clear();
-	
-	k=k+16;
-	hmm.resize(1<<_yDim);
-	sums.resize(1<<_yDim);
+	deterministic=true;
+	k=setupHeader(genome,start);
 	for(i=0;i<(1<<_yDim);i++)
     {
-		hmm[i].resize(1<<_xDim);
         int largestValueInRow = 0, largestValueInRowIndex = 0;
         
 		for(j=0;j<(1<<_xDim);j++)
@@ -140,45 +108,49 @@ void tHMMU::setupDeterministic(vector<unsigned char> &genome, int start){
 	
 }
 
-void tHMMU::update(unsigned char *states, unsigned char *newStates)
+void tHMMU::update(uint64_t states, uint64_t &newStates, tRNG &rng)
 {
 	int I=0;
 	int i,j,r;
 #ifdef feedbackON
     unsigned char mod;
+    // the last nrPos (nrNeg) decisions are rewarded (punished), oldest first
+    int firstPos=max(nrOfChosen-nrPos,0), firstNeg=max(nrOfChosen-nrNeg,0);
     
-	if((nrPos!=0)&&(states[posFBNode]==1))
+	if((nrPos!=0)&&(((states>>posFBNode)&1)==1))
     {
-		for(i=0;i<chosenInPos.size();i++)
+		for(i=0;i<nrOfChosen-firstPos;i++)
         {
-			mod=(unsigned char)(rand()%(int)posLevelOfFB[i]);
-			if((hmm[chosenInPos[i]][chosenOutPos[i]]+mod)<255)
+			unsigned char in=chosenIn[firstPos+i], out=chosenOut[firstPos+i];
+			mod=(unsigned char)rng.nextInt(posLevelOfFB[i]);
+			if((hmm[in][out]+mod)<255)
             {
-				hmm[chosenInPos[i]][chosenOutPos[i]]+=mod;
-				sums[chosenInPos[i]]+=mod;
+				hmm[in][out]+=mod;
+				sums[in]+=mod;
 			}
 		}
 	}
-	if((nrNeg!=0)&&(states[negFBNode]==1))
+	if((nrNeg!=0)&&(((states>>negFBNode)&1)==1))
     {
-		for(i=0;i<chosenInNeg.size();i++)
+		for(i=0;i<nrOfChosen-firstNeg;i++)
         {
-			mod=(unsigned char)(rand()%(int)negLevelOfFB[i]);
-			if((hmm[chosenInNeg[i]][chosenOutNeg[i]]-mod)>0)
+			unsigned char in=chosenIn[firstNeg+i], out=chosenOut[firstNeg+i];
+			mod=(unsigned char)rng.nextInt(negLevelOfFB[i]);
+			if((hmm[in][out]-mod)>0)
             {
-				hmm[chosenInNeg[i]][chosenOutNeg[i]]-=mod;
-				sums[chosenInNeg[i]]-=mod;
+				hmm[in][out]-=mod;
+				sums[in]-=mod;
 			}
 		}
 	}
 #endif
     
-	for(vector<int>::iterator it = ins.begin(), end = ins.end(); it != end; ++it)
+	for(i = 0; i < _yDim; ++i)
     {
-		I=(I<<1)+((states[*it])&1);
+		I=(I<<1)+((states>>ins[i])&1);
     }
     
-	r=1+(rand()%(sums[I]-1));
+	r=1+rng.nextInt(sums[I]-1);
 	j=0;
     //	cout<<I<<" "<<(int)hmm.size()<<" "<<(int)hmm[0].size()<<endl;
 	while(r > hmm[I][j])
@@ -187,59 +159,54 @@ void tHMMU::update(unsigned char *states, unsigned char *newStates)
 		++j;
 	}
     
-	for(i = 0; i < outs.size(); ++i)
+	for(i = 0; i < _xDim; ++i)
     {
-		newStates[outs[i]] |= (j >> i) & 1;
+		newStates |= (uint64_t)((j >> i) & 1) << outs[i];
     }
 #ifdef feedbackON
-	chosenInPos.push_back(I);
-	chosenInNeg.push_back(I);
-	chosenOutPos.push_back(j);
-	chosenOutNeg.push_back(j);
-	while(chosenInPos.size()>nrPos)
-    {
-        chosenInPos.pop_front();
-    }
-	while(chosenOutPos.size()>nrPos)
-    {
-        chosenOutPos.pop_front();
-    }
-	while(chosenInNeg.size()>nrNeg)
-    {
-        chosenInNeg.pop_front();
-    }
-	while(chosenOutNeg.size()>nrNeg)
+	// remember the decision, keeping as many as the feedback can reach back
+	if(nrOfChosen==maxFeedback)
     {
-        chosenOutNeg.pop_front();
+		for(i=1;i<maxFeedback;i++)
+        {
+			chosenIn[i-1]=chosenIn[i];
+			chosenOut[i-1]=chosenOut[i];
+        }
+		nrOfChosen--;
     }
+	chosenIn[nrOfChosen]=(unsigned char)I;
+	chosenOut[nrOfChosen]=(unsigned char)j;
+	nrOfChosen++;
 #endif
 }
 
 void tHMMU::show(void){
 	int i,j;
 	cout<<"INS: ";
-	for(i=0;i<ins.size();i++)
+	for(i=0;i<_yDim;i++)
 		cout<<(int)ins[i]<<" ";
 	cout<<endl;
 	cout<<"OUTS: ";
-	for(i=0;i<outs.size();i++)
+	for(i=0;i<_xDim;i++)
 		cout<<(int)outs[i]<<" ";
 	cout<<endl;
-	for(i=0;i<hmm.size();i++){
-		for(j=0;j<hmm[i].size();j++)
+	for(i=0;i<(1<<_yDim);i++){
+		for(j=0;j<(1<<_xDim);j++)
 			cout<<" "<<(double)hmm[i][j]/sums[i];
 		cout<<endl;
 	}
 	cout<<endl;
+#ifdef feedbackON
 	cout<<"posFB: "<<(int)posFBNode<<" negFB: "<<(int)negFBNode<<endl;
 	cout<<"posQue:"<<endl;
-	for(i=0;i<posLevelOfFB.size();i++)
+	for(i=0;i<nrPos;i++)
 		cout<<(int)posLevelOfFB[i]<<" ";
 	cout<<endl;
 	cout<<"negQue:"<<endl;
-	for(i=0;i<negLevelOfFB.size();i++)
+	for(i=0;i<nrNeg;i++)
 		cout<<(int)negLevelOfFB[i]<<" ";
 	cout<<endl;
+#endif
 /*
 	for(i=0;i<hmm.size();i++){
 		for(j=0;j<hmm[i].size();j++)
@@ -22,31 +22,50 @@
 #ifndef _tHMM_h_included_
 #define _tHMM_h_included_
 
+#include <stdint.h>
 #include <vector>
-#include <deque>
 #include <iostream>
 #include "globalConst.h"
+#include "tRNG.h"
 
 using namespace std;
 
+// maximum number of inputs and outputs of a gate (1 + (genome & 3))
+#define     maxGateIO       4
+// maximum number of past decisions a feedback gate rewards or punishes (genome & 3)
+#define     maxFeedback     3
+
+// a gate with all of its state inline, so gates can be stored and copied by value
 class tHMMU{
 public:
-	vector<vector<unsigned char> > hmm;
-	vector<unsigned int> sums;
-	vector<int> ins,outs;
+	// hmm[i][j]: weight of output pattern j for input pattern i, sums[i]: the weights of row i added up
+	// (only the first 1 << _yDim rows and 1 << _xDim columns are used)
+	unsigned char hmm[1 << maxGateIO][1 << maxGateIO];
+	unsigned short sums[1 << maxGateIO];
+	// the _yDim input and _xDim output nodes
+	unsigned char ins[maxGateIO], outs[maxGateIO];
+	unsigned char _xDim,_yDim;
+	// every row holds a single 255 entry, so the gate always picks the same output
+	bool deterministic;
+	// genome range the gate was decoded from: length nucleotides from the start codon on,
+	// wrapping around the end of the genome
+	int start,length;
+#ifdef feedbackON
 	unsigned char posFBNode,negFBNode;
 	unsigned char nrPos,nrNeg;
-	vector<int> posLevelOfFB,negLevelOfFB;
-	deque<unsigned char> chosenInPos,chosenInNeg,chosenOutPos,chosenOutNeg;
-	
-	unsigned char _xDim,_yDim;
+	int posLevelOfFB[maxFeedback],negLevelOfFB[maxFeedback];
+	// the last nrOfChosen decisions (input pattern and output pattern), oldest first
+	unsigned char chosenIn[maxFeedback],chosenOut[maxFeedback];
+	unsigned char nrOfChosen;
+#endif
 	tHMMU();
-	~tHMMU();
 	void setup(vector<unsigned char> &genome, int start);
 	void setupDeterministic(vector<unsigned char> &genome, int start);
-	void update(unsigned char *states,unsigned char *newStates);
+	void update(uint64_t states,uint64_t &newStates,tRNG &rng);
 	void show(void);
 	
+private:
+	int setupHeader(vector<unsigned char> &genome, int start);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,44 @@
+/*
+ * tRNG.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tRNG.h"
+
+tRNG::tRNG()
+{
+	seed(0);
+}
+
+tRNG::tRNG(uint64_t seed)
+{
+	this->seed(seed);
+}
+
+// expand a 64-bit seed into the full generator state with splitmix64
+void tRNG::seed(uint64_t seed)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		s[i] = z ^ (z >> 31);
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ * tRNG.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tRNG_h_included_
+#define _tRNG_h_included_
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// xoshiro256** random number generator
+// every agent draws from its own stream instead of the shared libc rand(),
+// so agents can be mutated and evaluated concurrently and any single
+// evaluation can be reproduced exactly from the stream's state
+class tRNG{
+public:
+	uint64_t s[4];
+
+	tRNG();
+	tRNG(uint64_t seed);
+	void seed(uint64_t seed);
+
+	// next raw 64-bit value
+	inline uint64_t next(void)
+	{
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+
+		return result;
+	}
+
+	// uniform integer in [0, n)
+	inline unsigned int nextInt(unsigned int n)
+	{
+		return (unsigned int)(((next() >> 32) * (uint64_t)n) >> 32);
+	}
+
+	// uniform double in [0, 1)
+	inline double nextDouble(void)
+	{
+		return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// Fisher-Yates shuffle of the given vector
+	template <class T> void shuffle(vector<T> &values)
+	{
+		for (int i = (int)values.size() - 1; i > 0; --i)
+		{
+			int j = (int)nextInt((unsigned int)(i + 1));
+			T swap = values[i];
+			values[i] = values[j];
+			values[j] = swap;
+		}
+	}
+
+private:
+	static inline uint64_t rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * tThreadPool.cpp
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tThreadPool.h"
+
+tThreadPool::tThreadPool(int nrOfThreads)
+{
+	currentJob = NULL;
+	nextIndex = 0;
+	jobCount = 0;
+	busyWorkers = 0;
+	jobGeneration = 0;
+	shuttingDown = false;
+
+	for (int thread = 1; thread < nrOfThreads; ++thread)
+	{
+		workers.push_back(std::thread(&tThreadPool::workerLoop, this, thread));
+	}
+}
+
+tThreadPool::~tThreadPool()
+{
+	{
+		unique_lock<mutex> guard(lock);
+		shuttingDown = true;
+	}
+	wake.notify_all();
+
+	for (int i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+}
+
+int tThreadPool::size(void)
+{
+	return (int)workers.size() + 1;
+}
+
+void tThreadPool::parallelFor(int count, const function<void(int, int)> &job)
+{
+	// nothing to hand off: run the loop on the calling thread
+	if (workers.empty())
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			job(i, 0);
+		}
+		return;
+	}
+
+	{
+		unique_lock<mutex> guard(lock);
+		currentJob = &job;
+		jobCount = count;
+		nextIndex = 0;
+		busyWorkers = (int)workers.size();
+		++jobGeneration;
+	}
+	wake.notify_all();
+
+	runJobs(0);
+
+	unique_lock<mutex> guard(lock);
+	while (busyWorkers > 0)
+	{
+		finished.wait(guard);
+	}
+	currentJob = NULL;
+}
+
+void tThreadPool::workerLoop(int thread)
+{
+	unsigned long seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			unique_lock<mutex> guard(lock);
+			while (!shuttingDown && jobGeneration == seenGeneration)
+			{
+				wake.wait(guard);
+			}
+
+			if (shuttingDown)
+			{
+				return;
+			}
+
+			seenGeneration = jobGeneration;
+		}
+
+		runJobs(thread);
+
+		unique_lock<mutex> guard(lock);
+		if (--busyWorkers == 0)
+		{
+			finished.notify_one();
+		}
+	}
+}
+
+// pull loop indices until there are none left
+void tThreadPool::runJobs(int thread)
+{
+	for (int i = nextIndex++; i < jobCount; i = nextIndex++)
+	{
+		(*currentJob)(i, thread);
+	}
+}
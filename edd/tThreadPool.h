@@ -0,0 +1,60 @@
+/*
+ * tThreadPool.h
+ *
+ * This file is part of the Evolved Digit Detector project.
+ *
+ * Copyright 2014 Randal S. Olson, Arend Hintze.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _tThreadPool_h_included_
+#define _tThreadPool_h_included_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// fixed set of worker threads that run the iterations of a loop concurrently
+// the calling thread takes part in the work as thread 0
+class tThreadPool{
+public:
+	tThreadPool(int nrOfThreads);
+	~tThreadPool();
+	int size(void);
+
+	// calls job(index, thread) for every index in [0, count) and returns once all calls are done
+	void parallelFor(int count, const function<void(int, int)> &job);
+
+private:
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake, finished;
+	const function<void(int, int)> *currentJob;
+	atomic<int> nextIndex;
+	int jobCount;
+	int busyWorkers;
+	unsigned long jobGeneration;
+	bool shuttingDown;
+
+	void workerLoop(int thread);
+	void runJobs(int thread);
+};
+
+#endif